@@ -0,0 +1,30 @@
+// The state shared by the programs of a pass, uploaded once per pass (see scene::Lighting::setPass)
+
+struct DirectionalLight
+{
+	vec3 directionView;
+	vec3 ambient, diffuse, specular;
+};
+
+struct MaterialDefinition
+{
+	vec3 specularColor;
+	float shininess;
+};
+
+layout(std140) uniform CameraBlock
+{
+	mat4 Projection;
+	mat4 View;
+};
+
+layout(std140) uniform LightBlock
+{
+	DirectionalLight Light;
+	MaterialDefinition Material;
+};
+
+layout(std140) uniform ShadowBlock
+{
+	mat4 ShadowViewProjection;
+};
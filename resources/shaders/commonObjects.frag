@@ -1,17 +1,11 @@
 #version 330
 
+#include "blocks.glsl"
+
 in vec4 color;
 
 out vec4 fragColor;
 
-struct MaterialDefinition
-{
-	vec3 specularColor;
-	float shininess;
-};
-
-uniform MaterialDefinition Material;
-
 vec4 computeLighting(vec3 ambient, vec3 diffuse, vec3 specular, float shininess);
 
 void main()
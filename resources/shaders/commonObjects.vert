@@ -1,15 +1,47 @@
 #version 330
 
 #include "includes.glsl"
+#include "blocks.glsl"
 
-void computePosition();
+uniform vec4 ClipPlane;
 
+// Horizontal displacement (x, z) per unit of height above the base of the object
+uniform vec2 Sway;
+
+POSITION in vec4 inPosition;
+NORMAL in vec3 inNormal;
 COLOR in vec4 inColor;
+MODEL in mat4 inModel;
 
+out vec3 position;
+out vec4 positionLight;
+out vec3 normal;
 out vec4 color;
 
 void main()
 {
-	computePosition();
+	// The last row of the instance matrix holds the height of its origin above the base of the object
+	mat4 local = inModel;
+	local[0][3] = 0.0;
+	vec3 base = local[3].xyz - vec3(0.0, inModel[0][3], 0.0);
+
+	// Shear around the base
+	mat4 shear = mat4(1.0);
+	shear[1][0] = Sway.x;
+	shear[1][2] = Sway.y;
+	shear[3] = vec4(base - mat3(shear) * base, 1.0);
+
+	mat4 model = shear * local;
+	mat4 modelView = View * model;
+
+	vec4 viewPos = modelView * inPosition;
+	positionLight = ShadowViewProjection * model * inPosition;
+	gl_Position = Projection * viewPos;
+
+	// This is so we can reuse the shader for water rendering
+	gl_ClipDistance[0] = dot(ClipPlane, model * inPosition);
+
+	position = viewPos.xyz;
+	normal = transpose(inverse(mat3(modelView))) * inNormal;
 	color = inColor;
 }
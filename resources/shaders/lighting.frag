@@ -1,12 +1,6 @@
 #version 330
 
-struct DirectionalLight
-{
-	vec3 directionView;
-	vec3 ambient, diffuse, specular;
-};
-
-uniform DirectionalLight Light;
+#include "blocks.glsl"
 
 uniform sampler2DShadow ShadowMapTexture;
 
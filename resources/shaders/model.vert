@@ -1,12 +1,10 @@
 #version 330
 
 #include "includes.glsl"
+#include "blocks.glsl"
 
 const int TotalNumBones = 128;
 
-uniform mat4 Projection;
-uniform mat4 View;
-uniform mat4 ShadowViewProjection;
 uniform vec4 ClipPlane;
 uniform mat4 Bones[TotalNumBones];
 
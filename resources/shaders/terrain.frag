@@ -1,5 +1,7 @@
 #version 330
 
+#include "blocks.glsl"
+
 uniform vec3 GrassColor, SandColor, MountainColor;
 uniform sampler3D NoiseTexture;
 uniform float UnitsPerPeriod;
@@ -7,14 +9,6 @@ uniform float UnitsPerPeriod;
 in vec4 modelPos;
 out vec4 fragColor;
 
-struct MaterialDefinition
-{
-	vec3 specularColor;
-	float shininess;
-};
-
-uniform MaterialDefinition Material;
-
 vec4 computeLighting(vec3 ambient, vec3 diffuse, vec3 specular, float shininess);
 
 void main()
@@ -1,16 +1,60 @@
 #version 330
 
 #include "includes.glsl"
+#include "blocks.glsl"
 
-void computePosition();
+uniform vec4 ClipPlane;
 
-POSITION in vec4 inPosition;
-NORMAL in vec3 inNormal;
+// The chunk being drawn: the XZ of its first sample, and the range its heights were quantized to (base, extent)
+uniform vec2 ChunkOrigin;
+uniform vec2 HeightRange;
+uniform float CellSize;
+uniform int ChunkSamples;
 
+// The vertices only store a normalized height and an octahedral normal
+POSITION in float inHeight;
+NORMAL in vec2 inNormal;
+
+out vec3 position;
+out vec4 positionLight;
+out vec3 normal;
 out vec4 modelPos;
 
+// The grid comes row by row, then the four skirts (bottom, top, left and right)
+ivec2 gridCoordinates(int id)
+{
+	int gridVertices = ChunkSamples * ChunkSamples;
+	if (id < gridVertices) return ivec2(id % ChunkSamples, id / ChunkSamples);
+
+	int edge = (id - gridVertices) / ChunkSamples, k = (id - gridVertices) % ChunkSamples, last = ChunkSamples - 1;
+	if (edge == 0) return ivec2(k, 0);
+	else if (edge == 1) return ivec2(k, last);
+	else if (edge == 2) return ivec2(0, k);
+	else return ivec2(last, k);
+}
+
+vec3 decodeNormal(vec2 e)
+{
+	vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+	if (n.y < 0.0) n.xz = (1.0 - abs(n.zx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.z >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
 void main()
 {
-	computePosition();
-	modelPos = vec4(inPosition.xyz, inNormal.y);
+	ivec2 ij = gridCoordinates(gl_VertexID);
+	vec4 worldPos = vec4(ChunkOrigin.x + ij.x * CellSize, HeightRange.x + inHeight * HeightRange.y,
+		ChunkOrigin.y - ij.y * CellSize, 1.0);
+	vec3 worldNormal = decodeNormal(inNormal);
+
+	vec4 viewPos = View * worldPos;
+	positionLight = ShadowViewProjection * worldPos;
+	gl_Position = Projection * viewPos;
+
+	// This is so we can reuse the shader for water rendering
+	gl_ClipDistance[0] = dot(ClipPlane, worldPos);
+
+	position = viewPos.xyz;
+	normal = transpose(inverse(mat3(View))) * worldNormal;
+	modelPos = vec4(worldPos.xyz, worldNormal.y);
 }
@@ -1,19 +1,12 @@
 #version 330
 
+#include "blocks.glsl"
+
 uniform sampler2D ReflectionTexture;
 uniform sampler2D RefractionTexture;
-uniform mat4 View;
 uniform vec3 ViewNormal;
 uniform float WaveHeight;
 
-struct DirectionalLight
-{
-	vec3 directionView;
-	vec3 ambient, diffuse, specular;
-};
-
-uniform DirectionalLight Light;
-
 uniform sampler2D RippleTextures[2];
 uniform vec2 Offsets[2];
 uniform sampler2DShadow ShadowMapTexture;
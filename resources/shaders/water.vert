@@ -1,11 +1,9 @@
 #version 330
 
 #include "includes.glsl"
+#include "blocks.glsl"
 
-uniform mat4 Projection;
-uniform mat4 View;
 uniform float RepeatPeriod;
-uniform mat4 ShadowViewProjection;
 
 POSITION in vec4 inPosition;
 
@@ -3,18 +3,21 @@
 #include <cstdlib>
 #include <iostream>
 #include <chrono>
+#include <string>
+#include <optional>
 
 #include "wrappers/glfw.hpp"
 #include "scene/Scene.hpp"
 #include "scene/ImGui.hpp"
 #include "resources/FileUtils.hpp"
 #include "resources/Cache.hpp"
+#include "terrainBenchmarks.hpp"
 
 using HighClock = std::chrono::high_resolution_clock;
 
 void enableOpenGLErrorHandler();
 
-int main()
+int main(int argc, char* argv[])
 {
     //std::string dummy;
     //std::getline(std::cin, dummy);
@@ -53,7 +56,33 @@ int main()
         glFrontFace(GL_CCW);
 
         file_utils::addDefaultLoaders();
-        scene::Scene scene(window);
+
+        if (argc > 1 && std::string(argv[1]) == "--benchmark-terrain")
+        {
+            bool passed = benchmarkTerrain(argc > 2 ? std::stof(argv[2]) : 1024.0f, argc > 3 ? argv[3] : "");
+            cache::clear();
+            return passed ? 0 : 1;
+        }
+
+        if (argc > 1 && std::string(argv[1]) == "--tune-terrain")
+        {
+            tuneTerrain(argc > 2 ? std::stof(argv[2]) : 1024.0f);
+            cache::clear();
+            return 0;
+        }
+
+        bool streamTerrain = false;
+        std::optional<int> terrainSeed;
+        std::size_t chunkCells = scene::Terrain::DefaultChunkCells;
+        for (int k = 1; k < argc; k++)
+        {
+            std::string arg = argv[k];
+            if (arg == "--stream-terrain") streamTerrain = true;
+            else if (arg == "--seed" && k + 1 < argc) terrainSeed = std::stoi(argv[++k]);
+            else if (arg == "--chunk-size" && k + 1 < argc) chunkCells = std::stoul(argv[++k]);
+        }
+
+        scene::Scene scene(window, streamTerrain, terrainSeed, chunkCells);
 
         auto then = HighClock::now();
         while (!window.shouldClose())
@@ -16,6 +16,10 @@ Model::Model()
         "resources/shaders/model.frag",
     });
     program->setName("Model Program");
+    program->setUniform("DiffuseTexture", 0);
+    program->setUniform("SpecularTexture", 1);
+    bonesUniform = program->getUniform<std::vector<glm::mat4>>("Bones");
+    shininessUniform = program->getUniform<float>("Shininess");
 
     curAnimation = 0;
 }
@@ -48,7 +52,6 @@ void Model::addNodes(std::unordered_map<const aiNode*, std::size_t> nodeIndices)
     nodeRelativeTransforms.resize(nodeIndices.size());
     nodeMeshStarts.resize(nodeIndices.size());
     nodeNumMeshes.resize(nodeIndices.size());
-    nodeNames.resize(nodeIndices.size());
 
     // Set the parent as the first
     nodeIndices[nullptr] = -1;
@@ -67,7 +70,6 @@ void Model::addNodes(std::unordered_map<const aiNode*, std::size_t> nodeIndices)
 
         // Set the node names for animations
         nodesByName[node->mName.C_Str()] = idx;
-        nodeNames[idx] = node->mName.C_Str();
 
         // Finally, we should store the mesh indices
         nodeMeshStarts[idx] = nodeMeshIndices.size();
@@ -89,32 +91,59 @@ void Model::fixAnimationReferences()
             mesh.boneNodeIndices[i] = nodesByName[mesh.boneNames[i]];
         mesh.boneNames.clear();
     }
+
+    // Then, the channels of the animations get their nodes
+    for (auto& animation : animations) animation.bindNodes(nodesByName);
+    if (!animations.empty()) animationCursor = animations[curAnimation].makeCursor();
 }
 
 void Model::setAnimation(std::string name)
 {
     curAnimation = std::find_if(animations.begin(), animations.end(),
         [&](const ModelAnimation& animation) { return animation.getName() == name; }) - animations.begin();
+    if (curAnimation < animations.size()) animationCursor = animations[curAnimation].makeCursor();
 }
 
 void Model::setTime(double time)
 {
-    // For each node that has a non-null animation, interpolate it
-    for (std::size_t i = 0; i < nodeParents.size(); i++)
-        animations[curAnimation].transformInterpolateChannel(nodeRelativeTransforms[i], time, nodeNames[i]);
+    // Interpolate the nodes that have a channel in the animation
+    animations[curAnimation].sample(time, animationCursor, nodeRelativeTransforms);
+    poseChanged = true;
 }
 
-void Model::draw(const glm::mat4& model)
+void Model::updatePose()
 {
     // Create the absolute node transforms
-    std::vector<glm::mat4> nodeBaseTransforms(nodeParents.size());
+    nodeBaseTransforms.resize(nodeParents.size());
     for (std::size_t i = 0; i < nodeParents.size(); i++)
     {
         if (nodeParents[i] == -1) nodeBaseTransforms[i] = glm::mat4(1.0);
         else nodeBaseTransforms[i] = nodeBaseTransforms[nodeParents[i]] * nodeRelativeTransforms[i];
     }
 
-    // Now, draw the meshes
+    // The vertex is transformed by the node of the mesh after the weighted sum of the bones, which is the same
+    // as transforming each bone by it
+    meshPalettes.resize(nodeMeshIndices.size());
+    for (std::size_t i = 0; i < nodeParents.size(); i++)
+        for (std::size_t j = nodeMeshStarts[i]; j < nodeMeshStarts[i] + nodeNumMeshes[i]; j++)
+        {
+            const auto& mesh = meshes[nodeMeshIndices[j]];
+            auto nodeTransform = nodeBaseTransforms[i] * globalInverseTransform;
+
+            auto& palette = meshPalettes[j];
+            palette.resize(mesh.boneNodeIndices.size());
+            for (std::size_t k = 0; k < palette.size(); k++)
+                palette[k] = nodeTransform * nodeBaseTransforms[mesh.boneNodeIndices[k]] * mesh.boneMatrices[k];
+        }
+
+    poseChanged = false;
+}
+
+template <typename DrawFn>
+void Model::drawMeshes(DrawFn drawMesh)
+{
+    if (poseChanged) updatePose();
+
     program->use();
     for (std::size_t i = 0; i < nodeParents.size(); i++)
     {
@@ -127,29 +156,23 @@ void Model::draw(const glm::mat4& model)
             auto& material = materials[mesh.materialIndex];
             
             // Set the material attributes
-            if (material.diffuseTexture)
-            {
-                material.diffuseTexture->bindTo(0);
-                program->setUniform("DiffuseTexture", 0);
-            }
-
-            if (material.specularTexture)
-            {
-                material.specularTexture->bindTo(1);
-                program->setUniform("SpecularTexture", 1);
-            }
-
-            program->setUniform("Shininess", material.shininess);
+            if (material.diffuseTexture) material.diffuseTexture->bindTo(0);
+            if (material.specularTexture) material.specularTexture->bindTo(1);
+            shininessUniform.set(material.shininess);
 
             // Set the bone transforms
-            for (unsigned int k = 0; k < mesh.boneNodeIndices.size(); k++)
-            {
-                std::string name = "Bones[" + std::to_string(k) + ']';
-                auto transform = nodeBaseTransforms[mesh.boneNodeIndices[k]] * mesh.boneMatrices[k];
-                program->setUniform(name.c_str(), globalInverseTransform * transform);
-            }
-
-            mesh.draw(model * nodeBaseTransforms[i]);
+            bonesUniform.set(meshPalettes[j]);
+            drawMesh(mesh);
         }
     }
 }
+
+void Model::draw(const glm::mat4& model)
+{
+    drawMeshes([&](const ModelMesh& mesh) { mesh.draw(model); });
+}
+
+void Model::draw(const gl::InstanceSet& instances)
+{
+    drawMeshes([&](const ModelMesh& mesh) { mesh.draw(instances); });
+}
@@ -4,6 +4,7 @@
 
 #include "resources/Program.hpp"
 #include "resources/Texture.hpp"
+#include "resources/InstanceSet.hpp"
 #include <memory>
 #include <unordered_map>
 #include "ModelMesh.hpp"
@@ -31,12 +32,26 @@ namespace model
         std::vector<unsigned int> nodeMeshIndices;
         std::vector<std::size_t> nodeMeshStarts;
         std::vector<std::size_t> nodeNumMeshes;
-        std::vector<std::string> nodeNames;
         std::unordered_map<std::string, std::size_t> nodesByName;
 
         glm::mat4 globalInverseTransform;
         std::vector<ModelAnimation> animations;
         std::size_t curAnimation;
+        ModelAnimation::Cursor animationCursor;
+
+        // The pose at the last time set, evaluated on the first draw after it: the absolute transform of each node,
+        // and the bones of each mesh drawn (in the order of nodeMeshIndices), with the transform of its node folded in
+        std::vector<glm::mat4> nodeBaseTransforms;
+        std::vector<std::vector<glm::mat4>> meshPalettes;
+        bool poseChanged = true;
+
+        gl::Uniform<std::vector<glm::mat4>> bonesUniform;
+        gl::Uniform<float> shininessUniform;
+
+        void updatePose();
+
+        template <typename DrawFn>
+        void drawMeshes(DrawFn drawMesh);
 
     public:
         Model();
@@ -56,6 +71,9 @@ namespace model
         void setTime(double time);
         void draw(const glm::mat4& model);
 
+        // Every instance in the same pose: a draw call and a palette upload per mesh, whatever the number of instances
+        void draw(const gl::InstanceSet& instances);
+
         std::shared_ptr<gl::Program> program;
     };
 }
\ No newline at end of file
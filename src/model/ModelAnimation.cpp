@@ -2,6 +2,7 @@
 
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <algorithm>
 
 using namespace model;
 
@@ -17,21 +18,36 @@ glm::tquat<T> toGlm(const aiQuaterniont<T>& quat)
     return glm::tquat<T>(quat.w, quat.x, quat.y, quat.z);
 }
 
-template <typename T>
-static auto getInterpolators(const std::vector<std::pair<double, T>>& val, double t)
+// How many keys to step over from the cursor before looking up the time with a binary search
+constexpr std::uint32_t MaxCursorSteps = 4;
+
+// The first key after t, starting from the one found last time: the keys are stepped over while the time only
+// moves forward a bit, and searched for when it jumps (or goes back, as when the animation loops)
+static std::uint32_t findKey(const std::vector<float>& times, float t, std::uint32_t& cursor)
 {
-    // First, do a upper_bound to pick up the best iterator
-    auto it = std::upper_bound(val.begin(), val.end(), t,
-        [](double t, const std::pair<double, T>& val) { return t < val.first; });
+    auto count = std::uint32_t(times.size());
+    if (cursor > count || (cursor > 0 && times[cursor - 1] > t)) cursor = 0;
+
+    for (std::uint32_t step = 0; cursor < count && times[cursor] <= t; step++, cursor++)
+        if (step == MaxCursorSteps)
+        {
+            cursor = std::uint32_t(std::upper_bound(times.begin() + cursor, times.end(), t) - times.begin());
+            break;
+        }
 
-    // If the iterator is on the beginning, just return it
-    if (it == val.begin()) return std::make_tuple(it->second, it->second, 0.0);
+    return cursor;
+}
 
-    // Else, if it is on the end, return the predecessor
-    else if (it == val.end()) return std::make_tuple(it[-1].second, it[-1].second, 0.0);
+template <typename T, typename Mix>
+static T interpolate(const std::vector<float>& times, const std::vector<T>& values, float t, std::uint32_t& cursor,
+    T fallback, Mix mix)
+{
+    if (values.empty()) return fallback;
 
-    // Else, return the two interpolands
-    else return std::make_tuple(it[-1].second, it->second, (t - it[-1].first) / (it->first - it[-1].first));
+    auto key = findKey(times, t, cursor);
+    if (key == 0) return values.front();
+    if (key == values.size()) return values.back();
+    return mix(values[key - 1], values[key], (t - times[key - 1]) / (times[key] - times[key - 1]));
 }
 
 ModelAnimation::ModelAnimation(const aiAnimation* anim)
@@ -44,58 +60,73 @@ ModelAnimation::ModelAnimation(const aiAnimation* anim)
     // Now, load each channel
     channels.reserve(anim->mNumChannels);
     for (unsigned int i = 0; i < anim->mNumChannels; i++)
-        channels.emplace(anim->mChannels[i]->mNodeName.C_Str(), anim->mChannels[i]);
+        channels.emplace_back(anim->mChannels[i]);
 }
 
-bool ModelAnimation::transformInterpolateChannel(glm::mat4& target, double t, const std::string& nodeName) const
+void ModelAnimation::bindNodes(const std::unordered_map<std::string, std::size_t>& nodesByName)
+{
+    channels.erase(std::remove_if(channels.begin(), channels.end(), [&](NodeChannel& channel)
+    {
+        auto it = nodesByName.find(channel.nodeName);
+        if (it == nodesByName.end()) return true;
+        channel.node = it->second;
+        return false;
+    }), channels.end());
+}
+
+void ModelAnimation::sample(double t, Cursor& cursor, std::vector<glm::mat4>& nodeTransforms) const
 {
     // Transform it into ticks
     t *= ticksPerSecond;
     t -= duration * std::floor(t / duration);
+    auto ticks = float(t);
 
-    // Find the character by name
-    auto it = channels.find(nodeName);
-    if (it != channels.end())
+    if (cursor.keys.size() != channels.size()) cursor = makeCursor();
+    for (std::size_t i = 0; i < channels.size(); i++)
     {
         // Now interpolate the positions, rotations and scales
-        const auto& channel = it->second;
+        const auto& channel = channels[i];
+        auto& keys = cursor.keys[i];
 
-        auto [pos1, pos2, f1] = getInterpolators(channel.positions, t);
-        auto pos = glm::mix(pos1, pos2, f1);
-        auto [quat1, quat2, f2] = getInterpolators(channel.rotations, t);
-        auto quat = glm::slerp(quat1, quat2, (float)f2);
-        auto [sca1, sca2, f3] = getInterpolators(channel.scales, t);
-        auto scale = glm::mix(sca1, sca2, f3);
+        auto mix = [](const glm::vec3& a, const glm::vec3& b, float f) { return glm::mix(a, b, f); };
+        auto pos = interpolate(channel.positionTimes, channel.positions, ticks, keys[0], glm::vec3(0), mix);
+        auto quat = interpolate(channel.rotationTimes, channel.rotations, ticks, keys[1], glm::quat(1, 0, 0, 0),
+            [](const glm::quat& a, const glm::quat& b, float f) { return glm::slerp(a, b, f); });
+        auto scale = interpolate(channel.scaleTimes, channel.scales, ticks, keys[2], glm::vec3(1), mix);
 
         // And compose the transformation
-        target = glm::translate(pos) * glm::mat4_cast(quat) * glm::scale(scale);
-        return true;
+        nodeTransforms[channel.node] = glm::translate(pos) * glm::mat4_cast(quat) * glm::scale(scale);
     }
-
-    return false;
 }
 
 NodeChannel::NodeChannel(const aiNodeAnim* anim)
 {
+    // The node is resolved by the model
+    nodeName = anim->mNodeName.C_Str();
+    node = 0;
+
     // Populate the positions, rotations and scales
+    positionTimes.resize(anim->mNumPositionKeys);
     positions.resize(anim->mNumPositionKeys);
     for (unsigned int i = 0; i < anim->mNumPositionKeys; i++)
     {
-        positions[i].first = anim->mPositionKeys[i].mTime;
-        positions[i].second = toGlm(anim->mPositionKeys[i].mValue);
+        positionTimes[i] = float(anim->mPositionKeys[i].mTime);
+        positions[i] = toGlm(anim->mPositionKeys[i].mValue);
     }
 
+    rotationTimes.resize(anim->mNumRotationKeys);
     rotations.resize(anim->mNumRotationKeys);
     for (unsigned int i = 0; i < anim->mNumRotationKeys; i++)
     {
-        rotations[i].first = anim->mRotationKeys[i].mTime;
-        rotations[i].second = toGlm(anim->mRotationKeys[i].mValue);
+        rotationTimes[i] = float(anim->mRotationKeys[i].mTime);
+        rotations[i] = toGlm(anim->mRotationKeys[i].mValue);
     }
 
+    scaleTimes.resize(anim->mNumScalingKeys);
     scales.resize(anim->mNumScalingKeys);
     for (unsigned int i = 0; i < anim->mNumScalingKeys; i++)
     {
-        scales[i].first = anim->mScalingKeys[i].mTime;
-        scales[i].second = toGlm(anim->mScalingKeys[i].mValue);
+        scaleTimes[i] = float(anim->mScalingKeys[i].mTime);
+        scales[i] = toGlm(anim->mScalingKeys[i].mValue);
     }
 }
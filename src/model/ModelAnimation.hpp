@@ -3,17 +3,24 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <vector>
-#include <utility>
+#include <array>
+#include <string>
+#include <cstdint>
 #include <unordered_map>
 #include <assimp/anim.h>
 
 namespace model
 {
+    // The keyframes of a node, each kind with its times (in ticks) apart from its values
     struct NodeChannel final
     {
-        std::vector<std::pair<double, glm::vec3>> positions;
-        std::vector<std::pair<double, glm::quat>> rotations;
-        std::vector<std::pair<double, glm::vec3>> scales;
+        std::string nodeName;
+        std::size_t node;
+
+        std::vector<float> positionTimes, rotationTimes, scaleTimes;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> scales;
 
         NodeChannel(const aiNodeAnim* anim);
     };
@@ -22,12 +29,25 @@ namespace model
     {
         double duration;
         double ticksPerSecond;
-        std::unordered_map<std::string, NodeChannel> channels;
+        std::vector<NodeChannel> channels;
         std::string name;
 
     public:
+        // Where each channel was sampled last (for the positions, rotations and scales, the first key after the
+        // time), so sampling a time after that one only steps over the keys in between
+        struct Cursor
+        {
+            std::vector<std::array<std::uint32_t, 3>> keys;
+        };
+
         ModelAnimation(const aiAnimation* anim);
-        bool transformInterpolateChannel(glm::mat4& target, double t, const std::string& nodeName) const;
+
+        // Resolve the nodes of the channels once; the channels of nodes the model doesn't have are dropped
+        void bindNodes(const std::unordered_map<std::string, std::size_t>& nodesByName);
+        Cursor makeCursor() const { return Cursor{ std::vector<std::array<std::uint32_t, 3>>(channels.size()) }; }
+
+        // Set the relative transforms of the animated nodes at time t (in seconds); allocates nothing
+        void sample(double t, Cursor& cursor, std::vector<glm::mat4>& nodeTransforms) const;
         const std::string& getName() const { return name; }
     };
-}
\ No newline at end of file
+}
@@ -168,7 +168,8 @@ void ModelMesh::draw(const glm::mat4& model) const
     // Bind the vertex array
     glBindVertexArray(vertexArray);
 
-    // Bind the vertex attribute
+    // Bind the vertex attribute (in place of the instances, if the mesh was drawn instanced before)
+    for (int i = 0; i < 4; i++) glDisableVertexAttribArray(4 + i);
     glVertexAttrib4fv(4, glm::value_ptr(model[0]));
     glVertexAttrib4fv(5, glm::value_ptr(model[1]));
     glVertexAttrib4fv(6, glm::value_ptr(model[2]));
@@ -177,3 +178,14 @@ void ModelMesh::draw(const glm::mat4& model) const
     // Use the appropriate draw function
     glDrawElements(static_cast<GLenum>(primitiveType), numElements, GL_UNSIGNED_INT, nullptr);
 }
+
+void ModelMesh::draw(const gl::InstanceSet& instances) const
+{
+    if (numElements == 0) return;
+
+    // Bind the vertex array and the instances
+    glBindVertexArray(vertexArray);
+    instances.useInstances();
+
+    glDrawElementsInstanced(static_cast<GLenum>(primitiveType), numElements, GL_UNSIGNED_INT, nullptr, instances.size());
+}
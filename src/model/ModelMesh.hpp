@@ -43,6 +43,7 @@ namespace model
 
         // Draw
         void draw(const glm::mat4& model) const;
+        void draw(const gl::InstanceSet& instances) const;
 
         friend class Model;
     };
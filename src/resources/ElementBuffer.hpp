@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gl
+{
+    // An index list that several meshes can share (see the Mesh constructor that takes one); it must outlive them
+    class ElementBuffer final
+    {
+        GLuint buffer;
+        GLsizei numElements;
+        GLenum indexType;
+
+        template <typename T>
+        void upload(const std::vector<T>& indices)
+        {
+            glGenBuffers(1, &buffer);
+
+            // Binding as an array buffer, so the element binding of whatever vertex array is bound stays untouched
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(T), indices.data(), GL_STATIC_DRAW);
+            numElements = indices.size();
+        }
+
+    public:
+        ElementBuffer() noexcept : buffer(0), numElements(0), indexType(GL_UNSIGNED_INT) {}
+        explicit ElementBuffer(const std::vector<std::uint16_t>& indices) : indexType(GL_UNSIGNED_SHORT) { upload(indices); }
+        explicit ElementBuffer(const std::vector<std::uint32_t>& indices) : indexType(GL_UNSIGNED_INT) { upload(indices); }
+        ~ElementBuffer() { glDeleteBuffers(1, &buffer); }
+
+        // Disallow copying
+        ElementBuffer(const ElementBuffer&) = delete;
+        ElementBuffer& operator=(const ElementBuffer&) = delete;
+
+        // Enable moving
+        ElementBuffer(ElementBuffer&& o) noexcept : buffer(o.buffer), numElements(o.numElements), indexType(o.indexType) { o.buffer = 0; }
+        ElementBuffer& operator=(ElementBuffer&& o) noexcept
+        {
+            std::swap(buffer, o.buffer);
+            std::swap(numElements, o.numElements);
+            std::swap(indexType, o.indexType);
+            return *this;
+        }
+
+        void setName(const std::string& name)
+        {
+            if (buffer) glObjectLabelKHR(GL_BUFFER, buffer, name.size(), name.data());
+        }
+
+        std::size_t size() const { return numElements; }
+        std::size_t indexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+
+        friend class Mesh;
+    };
+}
@@ -37,15 +37,24 @@ namespace gl
             numInstances = matrices.size();
         }
 
-        // Use them
-        void useInstances() const
+        // Upload again count of them, starting at first (they must already be there)
+        void updateInstances(std::size_t first, const glm::mat4* matrices, std::size_t count)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, matrixBuffer);
+            glBufferSubData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * first, sizeof(glm::mat4) * count, matrices);
+        }
+
+        GLsizei size() const { return numInstances; }
+
+        // Use them, starting at instance first (there is no base instance before OpenGL 4.2, so the attributes point there)
+        void useInstances(std::size_t first = 0) const
         {
             glBindBuffer(GL_ARRAY_BUFFER, matrixBuffer);
 
             for (int i = 0; i < 4; i++)
             {
                 glEnableVertexAttribArray(4 + i);
-                glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * i));
+                glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::mat4) * first + sizeof(glm::vec4) * i));
                 glVertexAttribDivisor(4 + i, 1); // This is what sets it instanced
             }
         }
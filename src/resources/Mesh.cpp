@@ -23,6 +23,11 @@ MeshBuilder gl::operator+(const MeshBuilder& mb1, const MeshBuilder& mb2)
 {
     MeshBuilder mesh;
 
+    // The packed attributes depend on how the shader decodes them, so they can't be merged
+    for (const auto& mb : { &mb1, &mb2 })
+        if (!mb->packedPositions.empty() || !mb->packedNormals.empty())
+            throw MeshException("Cannot concatenate meshes with packed attributes!");
+
     auto expSize1 = mb1.validateAndGetNumberOfVertices();
     auto expSize2 = mb2.validateAndGetNumberOfVertices();
 
@@ -70,11 +75,14 @@ MeshBuilder gl::operator+(const MeshBuilder& mb1, const MeshBuilder& mb2)
 
 std::size_t MeshBuilder::validateAndGetNumberOfVertices() const
 {
-    // Either you define normal coordinates or homogeneous coordinates, not both
-    if (!positions.empty() && !positionsH.empty())
-        throw MeshException("Cannot define positions and homogeneous positions at the same time!");
+    // Either you define normal coordinates, homogeneous coordinates or packed ones, only one of them
+    if (!positions.empty() + !positionsH.empty() + !packedPositions.empty() > 1)
+        throw MeshException("Cannot define more than one kind of positions at the same time!");
+    if (!normals.empty() && !packedNormals.empty())
+        throw MeshException("Cannot define normals and packed normals at the same time!");
 
-    auto sizes = { positions.size(), positionsH.size(), normals.size(), colors.size(), texcoords.size() };
+    auto sizes = { positions.size(), positionsH.size(), packedPositions.size(), normals.size(), packedNormals.size(),
+        colors.size(), texcoords.size() };
 
     // First, ensure the consistency of the meshBuilder
     auto expectedSize = std::max(sizes);
@@ -91,7 +99,8 @@ MeshBuilder& MeshBuilder::operator+=(const MeshBuilder& other)
     return *this;
 }
 
-Mesh::Mesh(const MeshBuilder& meshBuilder, PrimitiveType primitiveType) : primitiveType(primitiveType)
+Mesh::Mesh(const MeshBuilder& meshBuilder, PrimitiveType primitiveType) : primitiveType(primitiveType),
+    indexType(GL_UNSIGNED_INT), sharedElements(false)
 {
     auto numVertices = meshBuilder.validateAndGetNumberOfVertices();
    
@@ -102,10 +111,14 @@ Mesh::Mesh(const MeshBuilder& meshBuilder, PrimitiveType primitiveType) : primit
     glBindVertexArray(vertexArray); 
 
     // Generate and configure the attributes
-    if (meshBuilder.positionsH.empty())
+    if (!meshBuilder.packedPositions.empty())
+        positionBuffer = createAndConfigureVertexArray(meshBuilder.packedPositions, 0, true);
+    else if (meshBuilder.positionsH.empty())
         positionBuffer = createAndConfigureVertexArray(meshBuilder.positions, 0);
     else positionBuffer = createAndConfigureVertexArray(meshBuilder.positionsH, 0);
-    normalBuffer = createAndConfigureVertexArray(meshBuilder.normals, 1);
+    if (!meshBuilder.packedNormals.empty())
+        normalBuffer = createAndConfigureVertexArray(meshBuilder.packedNormals, 1, true);
+    else normalBuffer = createAndConfigureVertexArray(meshBuilder.normals, 1);
     colorBuffer = createAndConfigureVertexArray(meshBuilder.colors, 2, true);
     texcoordBuffer = createAndConfigureVertexArray(meshBuilder.texcoords, 3);
 
@@ -117,6 +130,29 @@ Mesh::Mesh(const MeshBuilder& meshBuilder, PrimitiveType primitiveType) : primit
     glBindVertexArray(0);
 }
 
+Mesh::Mesh(const MeshBuilder& meshBuilder, const ElementBuffer& elements, PrimitiveType primitiveType) : Mesh(meshBuilder, primitiveType)
+{
+    if (!meshBuilder.indices.empty())
+        throw MeshException("Cannot use a shared element buffer with a builder that has its own indices!");
+
+    setElements(elements);
+}
+
+void Mesh::setElements(const ElementBuffer& elements)
+{
+    if (!sharedElements) glDeleteBuffers(1, &elementBuffer);
+
+    // The binding is part of the vertex array state
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elements.buffer);
+    glBindVertexArray(0);
+
+    elementBuffer = elements.buffer;
+    indexType = elements.indexType;
+    sharedElements = true;
+    numElements = (unsigned int)elements.numElements;
+}
+
 Mesh Mesh::empty()
 {
     // Create an empty (but valid) mesh
@@ -132,6 +168,8 @@ Mesh& Mesh::operator=(Mesh&& mesh) noexcept
     std::swap(numElements, mesh.numElements);
     std::swap(primitiveType, mesh.primitiveType);
     std::swap(elementBuffer, mesh.elementBuffer);
+    std::swap(indexType, mesh.indexType);
+    std::swap(sharedElements, mesh.sharedElements);
     std::swap(positionBuffer, mesh.positionBuffer);
     std::swap(normalBuffer, mesh.normalBuffer);
     std::swap(colorBuffer, mesh.colorBuffer);
@@ -151,7 +189,7 @@ void Mesh::setName(const std::string& name)
     setBufferName(normalBuffer, name + " - normal");
     setBufferName(colorBuffer, name + " - color");
     setBufferName(texcoordBuffer, name + " - texcoord");
-    setBufferName(elementBuffer, name + " - elements");
+    if (!sharedElements) setBufferName(elementBuffer, name + " - elements");
 }
 
 template <typename T>
@@ -193,25 +231,68 @@ void Mesh::streamMesh(const MeshBuilder& meshBuilder, PrimitiveType newPrimitive
     glBindVertexArray(vertexArray);
 
     // Recreate all buffers
-    if (meshBuilder.positionsH.empty())
+    if (!meshBuilder.packedPositions.empty())
+        reconfigureVertexArrayStream(positionBuffer, meshBuilder.packedPositions, 0, true);
+    else if (meshBuilder.positionsH.empty())
         reconfigureVertexArrayStream(positionBuffer, meshBuilder.positions, 0);
     else reconfigureVertexArrayStream(positionBuffer, meshBuilder.positionsH, 0);
-    reconfigureVertexArrayStream(normalBuffer, meshBuilder.normals, 1);
+    if (!meshBuilder.packedNormals.empty())
+        reconfigureVertexArrayStream(normalBuffer, meshBuilder.packedNormals, 1, true);
+    else reconfigureVertexArrayStream(normalBuffer, meshBuilder.normals, 1);
     reconfigureVertexArrayStream(colorBuffer, meshBuilder.colors, 2, true);
     reconfigureVertexArrayStream(texcoordBuffer, meshBuilder.texcoords, 3);
 
-    // Rebuild the index list
-    refillBufferStream(elementBuffer, meshBuilder.indices, GL_ELEMENT_ARRAY_BUFFER);
-    numElements = (unsigned int)(meshBuilder.indices.empty() ? numVertices : meshBuilder.indices.size());
+    // Rebuild the index list, unless the topology is shared (then only the vertices change)
+    if (sharedElements && !meshBuilder.indices.empty())
+    {
+        elementBuffer = 0;
+        indexType = GL_UNSIGNED_INT;
+        sharedElements = false;
+    }
+
+    if (!sharedElements)
+    {
+        refillBufferStream(elementBuffer, meshBuilder.indices, GL_ELEMENT_ARRAY_BUFFER);
+        numElements = (unsigned int)(meshBuilder.indices.empty() ? numVertices : meshBuilder.indices.size());
+    }
     primitiveType = newPrimitiveType;
 
     // Unbind it in order to avoid outside changes
     glBindVertexArray(0);
 }
 
+template <typename T>
+void updateBufferRange(GLuint buffer, std::size_t first, const std::vector<T>& data)
+{
+    if (data.empty()) return;
+    if (buffer == 0) throw MeshException("Updating an attribute the mesh doesn't have");
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(T), data.size() * sizeof(T), data.data());
+}
+
+void Mesh::updateVertices(std::size_t first, const MeshBuilder& vertices)
+{
+    if (!vertices.indices.empty()) throw MeshException("Only the vertices can be updated in place");
+
+    // The attributes must match the ones the mesh was built with (there is no way to check the size here)
+    updateBufferRange(positionBuffer, first, vertices.packedPositions);
+    updateBufferRange(positionBuffer, first, vertices.positions);
+    updateBufferRange(positionBuffer, first, vertices.positionsH);
+    updateBufferRange(normalBuffer, first, vertices.packedNormals);
+    updateBufferRange(normalBuffer, first, vertices.normals);
+    updateBufferRange(colorBuffer, first, vertices.colors);
+    updateBufferRange(texcoordBuffer, first, vertices.texcoords);
+}
+
 void Mesh::draw(const glm::mat4& model) const
 {
-    if (numElements == 0) return;
+    draw(model, 0, numElements);
+}
+
+void Mesh::draw(const glm::mat4& model, std::size_t first, std::size_t count) const
+{
+    if (count == 0) return;
 
     // Bind the vertex array
     glBindVertexArray(vertexArray);
@@ -224,24 +305,30 @@ void Mesh::draw(const glm::mat4& model) const
 
     // Use the appropriate draw function
     auto mode = static_cast<GLenum>(primitiveType);
-    if (elementBuffer) glDrawElements(mode, numElements, GL_UNSIGNED_INT, nullptr);
-    else glDrawArrays(mode, 0, numElements);
+    auto indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    if (elementBuffer) glDrawElements(mode, count, indexType, (const void*)(first * indexSize));
+    else glDrawArrays(mode, first, count);
 }
 
 void Mesh::draw(const InstanceSet& instances) const
 {
-    if (numElements == 0) return;
+    draw(instances, 0, instances.numInstances);
+}
+
+void Mesh::draw(const InstanceSet& instances, std::size_t first, std::size_t count) const
+{
+    if (numElements == 0 || count == 0) return;
 
     // Bind the vertex array
     glBindVertexArray(vertexArray);
 
     // Bind the vertex attribute
-    instances.useInstances();
+    instances.useInstances(first);
 
     // Use the appropriate draw function
     auto mode = static_cast<GLenum>(primitiveType);
-    if (elementBuffer) glDrawElementsInstanced(mode, numElements, GL_UNSIGNED_INT, nullptr, instances.numInstances);
-    else glDrawArraysInstanced(mode, 0, numElements, instances.numInstances);
+    if (elementBuffer) glDrawElementsInstanced(mode, numElements, indexType, nullptr, count);
+    else glDrawArraysInstanced(mode, 0, numElements, count);
 }
 
 
@@ -250,7 +337,7 @@ Mesh::~Mesh()
     // Delete the vertex array
     glDeleteVertexArrays(1, &vertexArray);
 
-    glDeleteBuffers(1, &elementBuffer);
+    if (!sharedElements) glDeleteBuffers(1, &elementBuffer);
     glDeleteBuffers(1, &positionBuffer);
     glDeleteBuffers(1, &normalBuffer);
     glDeleteBuffers(1, &colorBuffer);
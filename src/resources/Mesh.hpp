@@ -2,9 +2,12 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+#include <cstdint>
 #include <vector>
 #include <stdexcept>
 #include "InstanceSet.hpp"
+#include "ElementBuffer.hpp"
 
 namespace gl
 {
@@ -25,6 +28,12 @@ namespace gl
         std::vector<glm::vec3> positions;
         std::vector<glm::vec4> positionsH;
         std::vector<glm::vec3> normals;
+
+        // Compact alternatives to the positions and normals: a single normalized 16-bit coordinate (the
+        // vertex shader rebuilds the others, e.g. from gl_VertexID) and octahedral-encoded 16-bit normals
+        std::vector<std::uint16_t> packedPositions;
+        std::vector<glm::i16vec2> packedNormals;
+
         std::vector<glm::u8vec4> colors;
         std::vector<glm::vec2> texcoords;
         std::vector<unsigned int> indices;
@@ -49,16 +58,25 @@ namespace gl
         unsigned int numElements;
         PrimitiveType primitiveType;
 
+        // The element buffer is not ours to delete when it is shared
         GLuint elementBuffer;
+        GLenum indexType;
+        bool sharedElements;
         GLuint positionBuffer, normalBuffer, colorBuffer, texcoordBuffer;
 
     public:
-        Mesh() noexcept : vertexArray(0), numElements(0), elementBuffer(0), positionBuffer(0), normalBuffer(0),
-            colorBuffer(0), texcoordBuffer(0) {}
+        Mesh() noexcept : vertexArray(0), numElements(0), elementBuffer(0), indexType(GL_UNSIGNED_INT), sharedElements(false),
+            positionBuffer(0), normalBuffer(0), colorBuffer(0), texcoordBuffer(0) {}
         Mesh(const MeshBuilder& meshBuilder, PrimitiveType primitiveType = PrimitiveType::Triangles);
 
+        // A mesh whose topology is the shared element buffer (the builder must not have indices)
+        Mesh(const MeshBuilder& meshBuilder, const ElementBuffer& elements, PrimitiveType primitiveType = PrimitiveType::Triangles);
+
         static Mesh empty();
 
+        // Switch to another shared element buffer (the mesh's own one, if any, is deleted)
+        void setElements(const ElementBuffer& elements);
+
         // Disable copying, enable moving
         Mesh(const Mesh&) = delete;
         Mesh& operator=(const Mesh&) = delete;
@@ -72,9 +90,14 @@ namespace gl
         // reupload the data
         void streamMesh(const MeshBuilder& meshBuilder, PrimitiveType newPrimitiveType = PrimitiveType::Triangles);
 
-        // draw the mesh
+        // overwrite the vertices from first on with the attributes the builder has (the others are left alone)
+        void updateVertices(std::size_t first, const MeshBuilder& vertices);
+
+        // draw the mesh, or only count elements of it starting at first (count instances for the instanced ones)
         void draw(const glm::mat4& modelMatrix) const;
+        void draw(const glm::mat4& modelMatrix, std::size_t first, std::size_t count) const;
         void draw(const InstanceSet& instances) const;
+        void draw(const InstanceSet& instances, std::size_t first, std::size_t count) const;
 
         // destructor
         ~Mesh();
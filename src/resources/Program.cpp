@@ -2,6 +2,7 @@
 
 #include "wrappers/glException.hpp"
 #include <glm/gtc/type_ptr.hpp>
+#include <cstring>
 
 using namespace gl;
 
@@ -13,6 +14,114 @@ void Program::relink()
     GLint status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
     if (!status) throw ProgramException("Failed to link program: " + getInfoLog());
+    loadUniforms();
+}
+
+void Program::loadUniforms()
+{
+    uniforms.clear();
+    uniformNames.clear();
+    uniformSlots.clear();
+
+    GLint count, maxLength;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::string name(std::max(maxLength, 1), 0);
+    for (GLint i = 0; i < count; i++)
+    {
+        // The members of the blocks are set through their buffers
+        GLuint index = i;
+        GLint block;
+        glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block);
+        if (block != -1) continue;
+
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program, index, maxLength, &length, &size, &type, &name[0]);
+        auto view = std::string_view(name.data(), length);
+
+        // The arrays are listed by their first element, and are set whole by their name too; those aren't
+        // shadowed, since their elements are slots of their own
+        uniforms.push_back({ glGetUniformLocation(program, name.c_str()), type, size == 1, {} });
+        addUniform(view, uniforms.size() - 1);
+        if (view.size() > 3 && view.substr(view.size() - 3) == "[0]")
+        {
+            uniforms.back().shadowed = false;
+            addUniform(view.substr(0, view.size() - 3), uniforms.size() - 1);
+        }
+    }
+}
+
+void Program::addUniform(std::string_view name, std::size_t index)
+{
+    uniformNames.emplace_back(name);
+    uniformSlots.emplace(uniformNames.back(), index);
+}
+
+Program::UniformSlot Program::findUniform(const char* name)
+{
+    auto it = uniformSlots.find(name);
+    if (it != uniformSlots.end()) return { it->second };
+
+    // Only the first element of the arrays is listed
+    auto location = glGetUniformLocation(program, name);
+    auto index = NoUniform;
+    if (location != -1)
+    {
+        auto bracket = std::strchr(name, '[');
+        auto array = bracket ? uniformSlots.find(std::string_view(name, bracket - name)) : uniformSlots.end();
+        uniforms.push_back({ location, array != uniformSlots.end() ? uniforms[array->second].type : GLenum(0), false, {} });
+        index = uniforms.size() - 1;
+    }
+    else reportUniform(std::string("Uniform ") + name + " is not an active uniform of the program, so it's ignored");
+
+    addUniform(name, index);
+    return { index };
+}
+
+bool Program::changeUniform(UniformSlot slot, const void* data, std::size_t size)
+{
+    if (slot.index == NoUniform || size == 0) return false;
+
+    auto& uniform = uniforms[slot.index];
+    if (uniform.shadowed)
+    {
+        if (uniform.value.size() == size && std::memcmp(uniform.value.data(), data, size) == 0) return false;
+        auto bytes = static_cast<const unsigned char*>(data);
+        uniform.value.assign(bytes, bytes + size);
+    }
+
+    use();
+    return true;
+}
+
+void Program::reportUniform(const std::string& message) const
+{
+    if (!GLAD_GL_KHR_debug) return;
+    auto text = message + " (program " + std::to_string(program) + ")";
+    glDebugMessageInsertKHR(GL_DEBUG_SOURCE_APPLICATION_KHR, GL_DEBUG_TYPE_ERROR_KHR, 0, GL_DEBUG_SEVERITY_MEDIUM_KHR,
+        GLsizei(text.size()), text.data());
+}
+
+bool Program::typeMatches(GLenum declared, GLenum requested)
+{
+    if (declared == requested) return true;
+
+    // The samplers are set by their unit
+    switch (declared)
+    {
+    case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_BUFFER: case GL_SAMPLER_2D_RECT: case GL_SAMPLER_2D_RECT_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+    case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D:
+        return requested == GL_INT;
+    case GL_BOOL: return requested == GL_INT || requested == GL_UNSIGNED_INT || requested == GL_FLOAT;
+    default: return false;
+    }
 }
 
 void Program::use() const
@@ -53,245 +162,486 @@ Program::~Program()
 
 void Program::setUniform(const char* name, float value)
 {
-    use(); glUniform1f(getUniformLocation(name), value);
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::vec1& value)
 {
-    use(); glUniform1f(getUniformLocation(name), value.x);
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::vec2& value)
 {
-    use(); glUniform2fv(getUniformLocation(name), 1, glm::value_ptr(value));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::vec3& value)
 {
-    use(); glUniform3fv(getUniformLocation(name), 1, glm::value_ptr(value));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::vec4& value)
 {
-    use(); glUniform4fv(getUniformLocation(name), 1, glm::value_ptr(value));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, int value)
 {
-    use(); glUniform1i(getUniformLocation(name), value);
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::ivec1& value)
 {
-    use(); glUniform1i(getUniformLocation(name), value.x);
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::ivec2& value)
 {
-    use(); glUniform2iv(getUniformLocation(name), 1, glm::value_ptr(value));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::ivec3& value)
 {
-    use(); glUniform3iv(getUniformLocation(name), 1, glm::value_ptr(value));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::ivec4& value)
 {
-    use(); glUniform4iv(getUniformLocation(name), 1, glm::value_ptr(value));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, unsigned int value)
 {
-    use(); glUniform1ui(getUniformLocation(name), value);
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::uvec1& value)
 {
-    use(); glUniform1ui(getUniformLocation(name), value.x);
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::uvec2& value)
 {
-    use(); glUniform2uiv(getUniformLocation(name), 1, glm::value_ptr(value));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::uvec3& value)
 {
-    use(); glUniform3uiv(getUniformLocation(name), 1, glm::value_ptr(value));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::uvec4& value)
 {
-    use(); glUniform4uiv(getUniformLocation(name), 1, glm::value_ptr(value));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const glm::mat2& value, bool transpose)
 {
-    use(); glUniformMatrix2fv(getUniformLocation(name), 1, transpose, glm::value_ptr(value));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const glm::mat3& value, bool transpose)
 {
-    use(); glUniformMatrix3fv(getUniformLocation(name), 1, transpose, glm::value_ptr(value));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const glm::mat4& value, bool transpose)
 {
-    use(); glUniformMatrix4fv(getUniformLocation(name), 1, transpose, glm::value_ptr(value));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const glm::mat2x3& value, bool transpose)
 {
-    use(); glUniformMatrix2x3fv(getUniformLocation(name), 1, transpose, glm::value_ptr(value));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const glm::mat3x2& value, bool transpose)
 {
-    use(); glUniformMatrix3x2fv(getUniformLocation(name), 1, transpose, glm::value_ptr(value));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const glm::mat2x4& value, bool transpose)
 {
-    use(); glUniformMatrix2x4fv(getUniformLocation(name), 1, transpose, glm::value_ptr(value));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const glm::mat4x2& value, bool transpose)
 {
-    use(); glUniformMatrix4x2fv(getUniformLocation(name), 1, transpose, glm::value_ptr(value));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const glm::mat3x4& value, bool transpose)
 {
-    use(); glUniformMatrix3x4fv(getUniformLocation(name), 1, transpose, glm::value_ptr(value));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const glm::mat4x3& value, bool transpose)
 {
-    use(); glUniformMatrix4x3fv(getUniformLocation(name), 1, transpose, glm::value_ptr(value));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const std::vector<float>& value)
 {
-    use(); glUniform1fv(getUniformLocation(name), (GLsizei)value.size(), value.data());
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::vec1>& value)
 {
-    use(); glUniform1fv(getUniformLocation(name), (GLsizei)value.size(), &value[0].x);
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::vec2>& value)
 {
-    use(); glUniform2fv(getUniformLocation(name), (GLsizei)value.size(), glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::vec3>& value)
 {
-    use(); glUniform3fv(getUniformLocation(name), (GLsizei)value.size(), glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::vec4>& value)
 {
-    use(); glUniform4fv(getUniformLocation(name), (GLsizei)value.size(), glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<int>& value)
 {
-    use(); glUniform1iv(getUniformLocation(name), (GLsizei)value.size(), value.data());
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::ivec1>& value)
 {
-    use(); glUniform1iv(getUniformLocation(name), (GLsizei)value.size(), &value[0].x);
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::ivec2>& value)
 {
-    use(); glUniform2iv(getUniformLocation(name), (GLsizei)value.size(), glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::ivec3>& value)
 {
-    use(); glUniform3iv(getUniformLocation(name), (GLsizei)value.size(), glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::ivec4>& value)
 {
-    use(); glUniform4iv(getUniformLocation(name), (GLsizei)value.size(), glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<unsigned int>& value)
 {
-    use(); glUniform1uiv(getUniformLocation(name), (GLsizei)value.size(), value.data());
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::uvec1>& value)
 {
-    use(); glUniform1uiv(getUniformLocation(name), (GLsizei)value.size(), &value[0].x);
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::uvec2>& value)
 {
-    use(); glUniform2uiv(getUniformLocation(name), (GLsizei)value.size(), glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::uvec3>& value)
 {
-    use(); glUniform3uiv(getUniformLocation(name), (GLsizei)value.size(), glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::uvec4>& value)
 {
-    use(); glUniform4uiv(getUniformLocation(name), (GLsizei)value.size(), glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::mat2>& value, bool transpose)
 {
-    use(); glUniformMatrix2fv(getUniformLocation(name), (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::mat3>& value, bool transpose)
 {
-    use(); glUniformMatrix3fv(getUniformLocation(name), (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::mat4>& value, bool transpose)
 {
-    use(); glUniformMatrix4fv(getUniformLocation(name), (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::mat2x3>& value, bool transpose)
 {
-    use(); glUniformMatrix2x3fv(getUniformLocation(name), (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::mat3x2>& value, bool transpose)
 {
-    use(); glUniformMatrix3x2fv(getUniformLocation(name), (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::mat2x4>& value, bool transpose)
 {
-    use(); glUniformMatrix2x4fv(getUniformLocation(name), (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::mat4x2>& value, bool transpose)
 {
-    use(); glUniformMatrix4x2fv(getUniformLocation(name), (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::mat3x4>& value, bool transpose)
 {
-    use(); glUniformMatrix3x4fv(getUniformLocation(name), (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value, transpose);
 }
 
 void Program::setUniform(const char* name, const std::vector<glm::mat4x3>& value, bool transpose)
 {
-    use(); glUniformMatrix4x3fv(getUniformLocation(name), (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+    setUniform(findUniform(name), value, transpose);
+}
+
+void Program::setUniform(UniformSlot slot, float value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform1f(uniforms[slot.index].location, value);
+}
+
+void Program::setUniform(UniformSlot slot, const glm::vec1& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform1f(uniforms[slot.index].location, value.x);
+}
+
+void Program::setUniform(UniformSlot slot, const glm::vec2& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform2fv(uniforms[slot.index].location, 1, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::vec3& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform3fv(uniforms[slot.index].location, 1, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::vec4& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform4fv(uniforms[slot.index].location, 1, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, int value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform1i(uniforms[slot.index].location, value);
+}
+
+void Program::setUniform(UniformSlot slot, const glm::ivec1& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform1i(uniforms[slot.index].location, value.x);
+}
+
+void Program::setUniform(UniformSlot slot, const glm::ivec2& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform2iv(uniforms[slot.index].location, 1, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::ivec3& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform3iv(uniforms[slot.index].location, 1, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::ivec4& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform4iv(uniforms[slot.index].location, 1, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, unsigned int value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform1ui(uniforms[slot.index].location, value);
+}
+
+void Program::setUniform(UniformSlot slot, const glm::uvec1& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform1ui(uniforms[slot.index].location, value.x);
+}
+
+void Program::setUniform(UniformSlot slot, const glm::uvec2& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform2uiv(uniforms[slot.index].location, 1, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::uvec3& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform3uiv(uniforms[slot.index].location, 1, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::uvec4& value)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniform4uiv(uniforms[slot.index].location, 1, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::mat2& value, bool transpose)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniformMatrix2fv(uniforms[slot.index].location, 1, transpose, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::mat3& value, bool transpose)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniformMatrix3fv(uniforms[slot.index].location, 1, transpose, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::mat4& value, bool transpose)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniformMatrix4fv(uniforms[slot.index].location, 1, transpose, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::mat2x3& value, bool transpose)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniformMatrix2x3fv(uniforms[slot.index].location, 1, transpose, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::mat3x2& value, bool transpose)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniformMatrix3x2fv(uniforms[slot.index].location, 1, transpose, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::mat2x4& value, bool transpose)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniformMatrix2x4fv(uniforms[slot.index].location, 1, transpose, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::mat4x2& value, bool transpose)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniformMatrix4x2fv(uniforms[slot.index].location, 1, transpose, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::mat3x4& value, bool transpose)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniformMatrix3x4fv(uniforms[slot.index].location, 1, transpose, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const glm::mat4x3& value, bool transpose)
+{
+    if (changeUniform(slot, &value, sizeof(value))) glUniformMatrix4x3fv(uniforms[slot.index].location, 1, transpose, glm::value_ptr(value));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<float>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform1fv(uniforms[slot.index].location, (GLsizei)value.size(), value.data());
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::vec1>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform1fv(uniforms[slot.index].location, (GLsizei)value.size(), &value[0].x);
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::vec2>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform2fv(uniforms[slot.index].location, (GLsizei)value.size(), glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::vec3>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform3fv(uniforms[slot.index].location, (GLsizei)value.size(), glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::vec4>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform4fv(uniforms[slot.index].location, (GLsizei)value.size(), glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<int>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform1iv(uniforms[slot.index].location, (GLsizei)value.size(), value.data());
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::ivec1>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform1iv(uniforms[slot.index].location, (GLsizei)value.size(), &value[0].x);
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::ivec2>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform2iv(uniforms[slot.index].location, (GLsizei)value.size(), glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::ivec3>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform3iv(uniforms[slot.index].location, (GLsizei)value.size(), glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::ivec4>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform4iv(uniforms[slot.index].location, (GLsizei)value.size(), glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<unsigned int>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform1uiv(uniforms[slot.index].location, (GLsizei)value.size(), value.data());
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::uvec1>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform1uiv(uniforms[slot.index].location, (GLsizei)value.size(), &value[0].x);
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::uvec2>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform2uiv(uniforms[slot.index].location, (GLsizei)value.size(), glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::uvec3>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform3uiv(uniforms[slot.index].location, (GLsizei)value.size(), glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::uvec4>& value)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniform4uiv(uniforms[slot.index].location, (GLsizei)value.size(), glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::mat2>& value, bool transpose)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniformMatrix2fv(uniforms[slot.index].location, (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::mat3>& value, bool transpose)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniformMatrix3fv(uniforms[slot.index].location, (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::mat4>& value, bool transpose)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniformMatrix4fv(uniforms[slot.index].location, (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::mat2x3>& value, bool transpose)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniformMatrix2x3fv(uniforms[slot.index].location, (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::mat3x2>& value, bool transpose)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniformMatrix3x2fv(uniforms[slot.index].location, (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::mat2x4>& value, bool transpose)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniformMatrix2x4fv(uniforms[slot.index].location, (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::mat4x2>& value, bool transpose)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniformMatrix4x2fv(uniforms[slot.index].location, (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::mat3x4>& value, bool transpose)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniformMatrix3x4fv(uniforms[slot.index].location, (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
+}
+
+void Program::setUniform(UniformSlot slot, const std::vector<glm::mat4x3>& value, bool transpose)
+{
+    if (changeUniform(slot, value.data(), value.size() * sizeof(value[0]))) glUniformMatrix4x3fv(uniforms[slot.index].location, (GLsizei)value.size(), transpose, glm::value_ptr(value[0]));
 }
 
 void gl::Program::bindUniformBlock(const char* name, int index)
 {
-    glUniformBlockBinding(program, getUniformBlockIndex(name), index);
+    auto blockIndex = getUniformBlockIndex(name);
+    if (blockIndex != GL_INVALID_INDEX) glUniformBlockBinding(program, blockIndex, index);
 }
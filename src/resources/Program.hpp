@@ -6,6 +6,9 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include <memory>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
 #include "Shader.hpp"
 
 namespace gl
@@ -16,12 +19,97 @@ namespace gl
         ProgramException(std::string what) : std::runtime_error(what) {}
     };
 
+    template <typename T>
+    class Uniform;
+
     class Program
     {
         static thread_local GLuint lastUsedProgram;
         GLuint program;
 
+        // The uniforms outside of the blocks, found when linking (and the array elements, when first set), each
+        // with a copy of the value last uploaded to it, so setting the same value again does nothing
+        struct UniformState
+        {
+            GLint location;
+            GLenum type;
+            bool shadowed;
+            std::vector<unsigned char> value;
+        };
+
+        struct UniformSlot { std::size_t index; };
+        static constexpr std::size_t NoUniform = -1;
+
+        std::vector<UniformState> uniforms;
+        std::deque<std::string> uniformNames;
+        std::unordered_map<std::string_view, std::size_t> uniformSlots;
+
         void relink();
+        void loadUniforms();
+        void addUniform(std::string_view name, std::size_t index);
+
+        // The names that aren't uniforms of the program are reported (once, through the debug output) and then ignored;
+        // this happens when a name is first used, not when linking, since the program doesn't know which names its
+        // users expect (a name that is never set is never checked)
+        UniformSlot findUniform(const char* name);
+        bool changeUniform(UniformSlot slot, const void* data, std::size_t size);
+        void reportUniform(const std::string& message) const;
+        static bool typeMatches(GLenum declared, GLenum requested);
+
+        void setUniform(UniformSlot slot, float value);
+        void setUniform(UniformSlot slot, const glm::vec1& value);
+        void setUniform(UniformSlot slot, const glm::vec2& value);
+        void setUniform(UniformSlot slot, const glm::vec3& value);
+        void setUniform(UniformSlot slot, const glm::vec4& value);
+        void setUniform(UniformSlot slot, int value);
+        void setUniform(UniformSlot slot, const glm::ivec1& value);
+        void setUniform(UniformSlot slot, const glm::ivec2& value);
+        void setUniform(UniformSlot slot, const glm::ivec3& value);
+        void setUniform(UniformSlot slot, const glm::ivec4& value);
+        void setUniform(UniformSlot slot, unsigned int value);
+        void setUniform(UniformSlot slot, const glm::uvec1& value);
+        void setUniform(UniformSlot slot, const glm::uvec2& value);
+        void setUniform(UniformSlot slot, const glm::uvec3& value);
+        void setUniform(UniformSlot slot, const glm::uvec4& value);
+        void setUniform(UniformSlot slot, const glm::mat2& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const glm::mat3& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const glm::mat4& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const glm::mat2x3& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const glm::mat3x2& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const glm::mat2x4& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const glm::mat4x2& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const glm::mat3x4& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const glm::mat4x3& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const std::vector<float>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::vec1>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::vec2>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::vec3>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::vec4>& value);
+        void setUniform(UniformSlot slot, const std::vector<int>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::ivec1>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::ivec2>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::ivec3>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::ivec4>& value);
+        void setUniform(UniformSlot slot, const std::vector<unsigned int>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::uvec1>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::uvec2>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::uvec3>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::uvec4>& value);
+        void setUniform(UniformSlot slot, const std::vector<glm::mat2>& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const std::vector<glm::mat3>& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const std::vector<glm::mat4>& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const std::vector<glm::mat2x3>& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const std::vector<glm::mat3x2>& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const std::vector<glm::mat2x4>& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const std::vector<glm::mat4x2>& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const std::vector<glm::mat3x4>& value, bool transpose = false);
+        void setUniform(UniformSlot slot, const std::vector<glm::mat4x3>& value, bool transpose = false);
+
+        template <typename T>
+        friend class Uniform;
+
+        template <typename T>
+        static constexpr GLenum uniformType();
 
     public:
         Program() : program(0) {}
@@ -46,14 +134,19 @@ namespace gl
         Program& operator=(const Program&) = delete;
 
         // Enable moving
-        Program(Program&& o) noexcept : program(o.program) { o.program = 0; }
+        Program(Program&& o) noexcept : program(o.program), uniforms(std::move(o.uniforms)),
+            uniformNames(std::move(o.uniformNames)), uniformSlots(std::move(o.uniformSlots)) { o.program = 0; }
         Program& operator=(Program&& o) noexcept
         {
             std::swap(program, o.program);
+            std::swap(uniforms, o.uniforms);
+            std::swap(uniformNames, o.uniformNames);
+            std::swap(uniformSlots, o.uniformSlots);
             return *this;
         }
 
         void use() const;
+        GLuint id() const { return program; }
         bool isValid() const;
         std::string getInfoLog() const;
 
@@ -64,6 +157,12 @@ namespace gl
         auto getUniformLocation(const char* name) const { return glGetUniformLocation(program, name); }
         auto getUniformBlockIndex(const char* name) const { return glGetUniformBlockIndex(program, name); }
 
+        // A handle to set a uniform without looking it up; throws if the uniform is declared with another type, and
+        // reports it if it isn't declared at all. Take the handles right after creating the program, so the names
+        // are checked then rather than when they are first set
+        template <typename T>
+        Uniform<T> getUniform(const char* name);
+
         // All uniform setting functons
         void setUniform(const char* name, float value);
         void setUniform(const char* name, const glm::vec1& value);
@@ -116,9 +215,68 @@ namespace gl
         void setUniform(const char* name, const std::vector<glm::mat3x4>& value, bool transpose = false);
         void setUniform(const char* name, const std::vector<glm::mat4x3>& value, bool transpose = false);
 
+        // No-op for the blocks the program doesn't declare (or that the compiler dropped)
         void bindUniformBlock(const char* name, int index);
 
         // Destructor
         ~Program();
     };
+
+    // A uniform of a program, found once; setting it uploads only what changed. The program must outlive it
+    // (and not move), and a handle to a uniform the program doesn't have does nothing
+    template <typename T>
+    class Uniform final
+    {
+        Program* program = nullptr;
+        Program::UniformSlot slot = { Program::NoUniform };
+
+        friend class Program;
+        Uniform(Program* program, Program::UniformSlot slot) : program(program), slot(slot) {}
+
+    public:
+        Uniform() = default;
+
+        void set(const T& value) const
+        {
+            if (program) program->setUniform(slot, value);
+        }
+
+        bool isActive() const { return program && slot.index != Program::NoUniform; }
+    };
+
+    template <typename T>
+    constexpr GLenum Program::uniformType()
+    {
+        if constexpr (std::is_same_v<T, float> || std::is_same_v<T, glm::vec1>) return GL_FLOAT;
+        else if constexpr (std::is_same_v<T, glm::vec2>) return GL_FLOAT_VEC2;
+        else if constexpr (std::is_same_v<T, glm::vec3>) return GL_FLOAT_VEC3;
+        else if constexpr (std::is_same_v<T, glm::vec4>) return GL_FLOAT_VEC4;
+        else if constexpr (std::is_same_v<T, int> || std::is_same_v<T, glm::ivec1>) return GL_INT;
+        else if constexpr (std::is_same_v<T, glm::ivec2>) return GL_INT_VEC2;
+        else if constexpr (std::is_same_v<T, glm::ivec3>) return GL_INT_VEC3;
+        else if constexpr (std::is_same_v<T, glm::ivec4>) return GL_INT_VEC4;
+        else if constexpr (std::is_same_v<T, unsigned int> || std::is_same_v<T, glm::uvec1>) return GL_UNSIGNED_INT;
+        else if constexpr (std::is_same_v<T, glm::uvec2>) return GL_UNSIGNED_INT_VEC2;
+        else if constexpr (std::is_same_v<T, glm::uvec3>) return GL_UNSIGNED_INT_VEC3;
+        else if constexpr (std::is_same_v<T, glm::uvec4>) return GL_UNSIGNED_INT_VEC4;
+        else if constexpr (std::is_same_v<T, glm::mat2>) return GL_FLOAT_MAT2;
+        else if constexpr (std::is_same_v<T, glm::mat3>) return GL_FLOAT_MAT3;
+        else if constexpr (std::is_same_v<T, glm::mat4>) return GL_FLOAT_MAT4;
+        else if constexpr (std::is_same_v<T, glm::mat2x3>) return GL_FLOAT_MAT2x3;
+        else if constexpr (std::is_same_v<T, glm::mat3x2>) return GL_FLOAT_MAT3x2;
+        else if constexpr (std::is_same_v<T, glm::mat2x4>) return GL_FLOAT_MAT2x4;
+        else if constexpr (std::is_same_v<T, glm::mat4x2>) return GL_FLOAT_MAT4x2;
+        else if constexpr (std::is_same_v<T, glm::mat3x4>) return GL_FLOAT_MAT3x4;
+        else if constexpr (std::is_same_v<T, glm::mat4x3>) return GL_FLOAT_MAT4x3;
+        else return uniformType<typename T::value_type>();
+    }
+
+    template <typename T>
+    Uniform<T> Program::getUniform(const char* name)
+    {
+        auto slot = findUniform(name);
+        if (slot.index != NoUniform && !typeMatches(uniforms[slot.index].type, uniformType<T>()))
+            throw ProgramException("Uniform " + std::string(name) + " is declared with another type");
+        return Uniform<T>(this, slot);
+    }
 }
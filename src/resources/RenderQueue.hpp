@@ -0,0 +1,144 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <vector>
+#include "Program.hpp"
+#include "Texture.hpp"
+
+namespace gl
+{
+    // A texture to bind to a unit before a draw, whatever its target
+    struct TextureBinding final
+    {
+        const void* texture = nullptr;
+        GLuint unit = 0, id = 0;
+        void (*bind)(const void* texture, GLuint unit) = nullptr;
+
+        template <GLenum Target>
+        static TextureBinding of(const Texture<Target>& texture, GLuint unit)
+        {
+            return { &texture, unit, texture.id(), [](const void* t, GLuint u) { static_cast<const Texture<Target>*>(t)->bindTo(u); } };
+        }
+    };
+
+    // What was bound while executing the queue, against what the items asked for (a program and their textures each)
+    struct RenderQueueStats final
+    {
+        std::size_t items, programBinds, textureBinds, bindsSaved;
+
+        RenderQueueStats& operator+=(const RenderQueueStats& o)
+        {
+            items += o.items;
+            programBinds += o.programBinds;
+            textureBinds += o.textureBinds;
+            bindsSaved += o.bindsSaved;
+            return *this;
+        }
+    };
+
+    // The draws of a pass, collected from every part of the scene and then executed sorted by their key: the layer
+    // first (so the sky goes before everything else), then the program, the first texture and the depth, so the
+    // draws sharing a program and textures are together, and front to back among them for the early depth test
+    // (only among them: the state changes come first, so a far draw of one program can go before a near one of another)
+    class RenderQueue final
+    {
+    public:
+        static constexpr std::size_t MaxTextures = 2;
+
+        // The units the queue remembers the textures of (the ones above are always bound)
+        static constexpr GLuint TrackedUnits = 8;
+
+        struct Item
+        {
+            std::uint64_t key;
+            const Program* program;
+            TextureBinding textures[MaxTextures];
+
+            // Sets what is particular to the item (uniforms of its program, state) and draws; with bindsTextures, it
+            // binds textures of its own, so the queue forgets what it had bound
+            std::function<void()> draw;
+            bool bindsTextures;
+        };
+
+    private:
+        std::vector<Item> items;
+        std::vector<std::size_t> order;
+        RenderQueueStats stats = {};
+
+    public:
+        // Bits from the top: layer (8), program (12), texture (12), depth (32, non-negative, so its bits sort like it)
+        static std::uint64_t key(std::uint8_t layer, const Program& program, GLuint texture, float depth)
+        {
+            std::uint32_t depthBits;
+            depth = std::max(depth, 0.0f);
+            std::memcpy(&depthBits, &depth, sizeof(depthBits));
+            return (std::uint64_t(layer) << 56) | (std::uint64_t(program.id() & 0xFFF) << 44)
+                | (std::uint64_t(texture & 0xFFF) << 32) | depthBits;
+        }
+
+        void submit(Item item)
+        {
+            items.push_back(std::move(item));
+        }
+
+        void submit(std::uint8_t layer, const Program& program, float depth, std::function<void()> draw,
+            std::initializer_list<TextureBinding> textures = {}, bool bindsTextures = false)
+        {
+            Item item = { key(layer, program, textures.size() ? textures.begin()->id : 0, depth), &program, {}, std::move(draw), bindsTextures };
+            std::copy_n(textures.begin(), std::min(textures.size(), MaxTextures), item.textures);
+            submit(std::move(item));
+        }
+
+        std::size_t size() const { return items.size(); }
+
+        // Sort and draw everything submitted since the last time, binding only what changes from an item to the next
+        void execute()
+        {
+            order.resize(items.size());
+            for (std::size_t k = 0; k < items.size(); k++) order[k] = k;
+            std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return items[a].key < items[b].key; });
+
+            stats = { items.size(), 0, 0, 0 };
+            const Program* currentProgram = nullptr;
+            const void* bound[TrackedUnits] = {};
+            for (auto k : order)
+            {
+                auto& item = items[k];
+                if (item.program != currentProgram)
+                {
+                    item.program->use();
+                    currentProgram = item.program;
+                    stats.programBinds++;
+                }
+                else stats.bindsSaved++;
+
+                for (std::size_t t = 0; t < MaxTextures; t++)
+                {
+                    const auto& binding = item.textures[t];
+                    if (!binding.texture) continue;
+                    if (binding.unit >= TrackedUnits || bound[binding.unit] != binding.texture)
+                    {
+                        binding.bind(binding.texture, binding.unit);
+                        if (binding.unit < TrackedUnits) bound[binding.unit] = binding.texture;
+                        stats.textureBinds++;
+                    }
+                    else stats.bindsSaved++;
+                }
+
+                item.draw();
+                if (item.bindsTextures) std::fill(std::begin(bound), std::end(bound), nullptr);
+            }
+
+            items.clear();
+        }
+
+        // Of the last execute
+        auto getStats() const { return stats; }
+    };
+}
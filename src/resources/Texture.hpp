@@ -122,6 +122,8 @@ namespace gl
             glObjectLabelKHR(GL_TEXTURE, texture, name.size(), name.data());
         }
 
+        GLuint id() const { return texture; }
+
         void bind() const 
         { 
             if (lastBoundTexture != texture)
@@ -9,6 +9,7 @@ namespace gl
     class UniformBuffer final
     {
         GLuint buffer;
+        GLsizeiptr capacity = 0;
         inline static thread_local GLuint lastBufferBound = 0;
 
     public:
@@ -20,10 +21,11 @@ namespace gl
         UniformBuffer& operator=(const UniformBuffer&) = delete;
 
         // Enable moving
-        UniformBuffer(UniformBuffer&& o) noexcept : buffer(o.buffer) { o.buffer = 0; }
+        UniformBuffer(UniformBuffer&& o) noexcept : buffer(o.buffer), capacity(o.capacity) { o.buffer = 0; }
         UniformBuffer& operator=(UniformBuffer&& o) noexcept
         {
             std::swap(buffer, o.buffer);
+            std::swap(capacity, o.capacity);
             return *this;
         }
 
@@ -50,8 +52,24 @@ namespace gl
         void upload(const void* data, GLsizeiptr size)
         {
             bind(); glBufferData(GL_UNIFORM_BUFFER, size, data, GL_STATIC_DRAW);
+            capacity = size;
         }
 
+        // For the buffers rewritten often: the storage is only reallocated when it grows
+        void update(const void* data, GLsizeiptr size)
+        {
+            bind();
+            if (size <= capacity) glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+            else
+            {
+                glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+                capacity = size;
+            }
+        }
+
+        template <typename T>
+        void update(const T& value) { update(&value, sizeof(T)); }
+
         template <typename T, std::size_t N>
         void upload(const T val[N]) { upload(val, sizeof(T) * N); }
     };
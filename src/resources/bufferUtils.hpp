@@ -28,6 +28,13 @@ namespace gl
         using type = float;
     };
 
+    template <>
+    struct vector_traits<unsigned short>
+    {
+        static constexpr std::size_t size = 1;
+        using type = unsigned short;
+    };
+
     template <typename T>
     GLuint createAndFillBuffer(const T* data, std::size_t size, GLenum target = GL_ARRAY_BUFFER)
     {
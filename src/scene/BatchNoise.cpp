@@ -0,0 +1,265 @@
+#include "BatchNoise.hpp"
+
+#include <random>
+
+using namespace scene;
+using namespace util::simd;
+
+static const float GradX[] = { 1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0 };
+static const float GradY[] = { 1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1 };
+static const float GradZ[] = { 0, 0, 0, 0, 1, 1, -1, -1, 1, 1, -1, -1 };
+
+static const float F3 = 1 / float(3);
+static const float G3 = 1 / float(6);
+
+BatchNoise::BatchNoise(const FastNoise& noise) : frequency(noise.GetFrequency()), lacunarity(noise.GetFractalLacunarity()),
+    gain(noise.GetFractalGain()), octaves(noise.GetFractalOctaves())
+{
+    // The permutation tables are private to FastNoise, so rebuild them exactly like FastNoise::SetSeed does
+    std::mt19937_64 gen(noise.GetSeed());
+
+    for (int i = 0; i < 256; i++)
+        perm[i] = i;
+
+    for (int j = 0; j < 256; j++)
+    {
+        int rng = (int)(gen() % (256 - j));
+        int k = rng + j;
+        int l = perm[j];
+        perm[j] = perm[j + 256] = perm[k];
+        perm[k] = l;
+    }
+
+    for (int j = 0; j < 512; j++)
+    {
+        auto lutPos = perm[j] % 12;
+        gradX[j] = GradX[lutPos];
+        gradY[j] = GradY[lutPos];
+        gradZ[j] = GradZ[lutPos];
+    }
+
+    // Same thing for the fractal bounding (FastNoise::CalculateFractalBounding)
+    float amp = gain;
+    float ampFractal = 1.0f;
+    for (int i = 1; i < octaves; i++)
+    {
+        ampFractal += amp;
+        amp *= gain;
+    }
+    fractalBounding = 1.0f / ampFractal;
+}
+
+// FastNoise's floor, which is off by one for negative integers
+static int fastFloor(float f) { return f >= 0 ? (int)f : (int)f - 1; }
+static intv fastFloor(floatv f)
+{
+    auto t = truncate(f);
+    return select(f >= 0.0f, t, t - 1);
+}
+
+template <typename T>
+static T lerp(T a, T b, T t) { return a + t * (b - a); }
+
+template <typename T>
+static T interpQuintic(T t) { return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f); }
+
+// 30 t^2 (t - 1)^2
+template <typename T>
+static T interpQuinticDerivative(T t)
+{
+    auto u = t * (t - 1.0f);
+    return 30.0f * u * u;
+}
+
+floatv BatchNoise::gradCoord(intv lutPos, floatv xd, floatv yd, floatv zd) const
+{
+    return xd * gather(gradX, lutPos) + yd * gather(gradY, lutPos) + zd * gather(gradZ, lutPos);
+}
+
+// With the derivatives, the gradient is kept around (the dot product is computed the same way, so the value
+// doesn't change); dx and dy are only written when Derivatives is set
+template <bool Derivatives>
+floatv BatchNoise::singlePerlin(std::int32_t offset, floatv x, float y, float z, floatv& dx, floatv& dy) const
+{
+    auto x0 = fastFloor(x);
+    auto x1 = x0 + 1;
+    int y0 = fastFloor(y), y1 = y0 + 1;
+    int z0 = fastFloor(z), z1 = z0 + 1;
+
+    auto xd0 = x - toFloat(x0);
+    float yd0 = y - (float)y0;
+    float zd0 = z - (float)z0;
+    auto xd1 = xd0 - 1.0f;
+    float yd1 = yd0 - 1;
+    float zd1 = zd0 - 1;
+
+    auto xs = interpQuintic(xd0);
+    auto ys = interpQuintic(yd0);
+    auto zs = interpQuintic(zd0);
+
+    auto corner = [&](intv lutPos, floatv xd, floatv yd, floatv zd, floatv& gx, floatv& gy)
+    {
+        if constexpr (!Derivatives) return gradCoord(lutPos, xd, yd, zd);
+
+        gx = gather(gradX, lutPos);
+        gy = gather(gradY, lutPos);
+        return xd * gx + yd * gy + zd * gather(gradZ, lutPos);
+    };
+
+    // Interpolate a whole z plane; the y and z part of the hash is the same for every lane
+    auto plane = [&](int zi, float zd, floatv& pdx, floatv& pdy)
+    {
+        auto hz = perm[(zi & 0xff) + offset];
+        auto h0 = perm[(y0 & 0xff) + hz], h1 = perm[(y1 & 0xff) + hz];
+
+        floatv gx00, gy00, gx10, gy10, gx01, gy01, gx11, gy11;
+        auto g00 = corner((x0 & 0xff) + h0, xd0, yd0, zd, gx00, gy00);
+        auto g10 = corner((x1 & 0xff) + h0, xd1, yd0, zd, gx10, gy10);
+        auto g01 = corner((x0 & 0xff) + h1, xd0, yd1, zd, gx01, gy01);
+        auto g11 = corner((x1 & 0xff) + h1, xd1, yd1, zd, gx11, gy11);
+
+        auto xf0 = lerp(g00, g10, xs);
+        auto xf1 = lerp(g01, g11, xs);
+        if constexpr (Derivatives)
+        {
+            // The dot products change with the gradients, and the weights with the position in the cell
+            auto xsd = interpQuinticDerivative(xd0);
+            pdx = lerp(lerp(gx00, gx10, xs) + xsd * (g10 - g00), lerp(gx01, gx11, xs) + xsd * (g11 - g01), floatv(ys));
+            pdy = lerp(lerp(gy00, gy10, xs), lerp(gy01, gy11, xs), floatv(ys)) + interpQuinticDerivative(yd0) * (xf1 - xf0);
+        }
+
+        return lerp(xf0, xf1, floatv(ys));
+    };
+
+    // When z sits on the lattice (as it does for 2D sampling), the far plane has no weight at all
+    auto yf0 = plane(z0, zd0, dx, dy);
+    if (zs == 0) return yf0;
+
+    floatv dx1, dy1;
+    auto yf1 = plane(z1, zd1, dx1, dy1);
+    if constexpr (Derivatives)
+    {
+        dx = lerp(dx, dx1, floatv(zs));
+        dy = lerp(dy, dy1, floatv(zs));
+    }
+
+    return lerp(yf0, yf1, floatv(zs));
+}
+
+template <bool Derivatives>
+floatv BatchNoise::sumOctaves(floatv x, float y, float z, floatv& dx, floatv& dy) const
+{
+    x *= frequency;
+    y *= frequency;
+    z *= frequency;
+
+    floatv octaveDx, octaveDy;
+    auto sum = singlePerlin<Derivatives>(perm[0], x, y, z, octaveDx, octaveDy);
+    float amp = 1, scale = frequency;
+    if constexpr (Derivatives) dx = octaveDx * scale, dy = octaveDy * scale;
+    int i = 0;
+
+    while (++i < octaves)
+    {
+        x *= lacunarity;
+        y *= lacunarity;
+        z *= lacunarity;
+
+        amp *= gain;
+        sum += singlePerlin<Derivatives>(perm[i], x, y, z, octaveDx, octaveDy) * amp;
+
+        // Each octave is also stretched by the lacunarity
+        if constexpr (Derivatives)
+        {
+            scale *= lacunarity;
+            dx += octaveDx * (amp * scale);
+            dy += octaveDy * (amp * scale);
+        }
+    }
+
+    if constexpr (Derivatives) dx *= fractalBounding, dy *= fractalBounding;
+    return sum * fractalBounding;
+}
+
+floatv BatchNoise::perlinFractal(floatv x, float y, float z) const
+{
+    floatv dx, dy;
+    return sumOctaves<false>(x, y, z, dx, dy);
+}
+
+floatv BatchNoise::perlinFractal(floatv x, float y, float z, floatv& dx, floatv& dy) const
+{
+    return sumOctaves<true>(x, y, z, dx, dy);
+}
+
+template <bool Derivatives>
+floatv BatchNoise::singleSimplex(std::int32_t offset, floatv x, floatv y, floatv z, floatv& dx, floatv& dy) const
+{
+    auto t = (x + y + z) * F3;
+    auto i = fastFloor(x + t);
+    auto j = fastFloor(y + t);
+    auto k = fastFloor(z + t);
+
+    t = toFloat(i + j + k) * G3;
+    auto x0 = x - (toFloat(i) - t);
+    auto y0 = y - (toFloat(j) - t);
+    auto z0 = z - (toFloat(k) - t);
+
+    // The branchy simplex selection of FastNoise, turned into masks
+    auto xy = x0 >= y0, yz = y0 >= z0, xz = x0 >= z0;
+    auto i1 = xy & (yz | xz), j1 = ~xy & yz, k1 = ~yz & ~(xy & xz);
+    auto i2 = xy | (yz & xz), j2 = ~xy | yz, k2 = (xy & ~yz) | (~xy & ~(yz & xz));
+
+    auto one = [](maskv m) { return select(m, floatv(1.0f), floatv(0.0f)); };
+    auto onei = [](maskv m) { return select(m, intv(1), intv(0)); };
+
+    auto x1 = x0 - one(i1) + G3;
+    auto y1 = y0 - one(j1) + G3;
+    auto z1 = z0 - one(k1) + G3;
+    auto x2 = x0 - one(i2) + 2 * G3;
+    auto y2 = y0 - one(j2) + 2 * G3;
+    auto z2 = z0 - one(k2) + 2 * G3;
+    auto x3 = x0 - 1.0f + 3 * G3;
+    auto y3 = y0 - 1.0f + 3 * G3;
+    auto z3 = z0 - 1.0f + 3 * G3;
+
+    // Each corner adds t^4 (g . d), with t = 0.6 - d . d, so its derivative is t^4 g - 8 t^3 (g . d) d
+    auto corner = [&](floatv xd, floatv yd, floatv zd, intv ci, intv cj, intv ck)
+    {
+        auto lutPos = (ci & 0xff) + gather(perm, (cj & 0xff) + gather(perm, (ck & 0xff) + offset));
+        auto t = floatv(0.6f) - xd * xd - yd * yd - zd * zd;
+        auto t2 = t * t;
+        auto outside = t < 0.0f;
+        if constexpr (!Derivatives) return select(outside, floatv(0.0f), t2 * t2 * gradCoord(lutPos, xd, yd, zd));
+
+        auto gx = gather(gradX, lutPos), gy = gather(gradY, lutPos);
+        auto g = xd * gx + yd * gy + zd * gather(gradZ, lutPos);
+        auto t4 = t2 * t2, t3g = -8.0f * t2 * t * g;
+        dx += select(outside, floatv(0.0f), t4 * gx + t3g * xd);
+        dy += select(outside, floatv(0.0f), t4 * gy + t3g * yd);
+        return select(outside, floatv(0.0f), t4 * g);
+    };
+
+    if constexpr (Derivatives) dx = dy = 0.0f;
+    auto n0 = corner(x0, y0, z0, i, j, k);
+    auto n1 = corner(x1, y1, z1, i + onei(i1), j + onei(j1), k + onei(k1));
+    auto n2 = corner(x2, y2, z2, i + onei(i2), j + onei(j2), k + onei(k2));
+    auto n3 = corner(x3, y3, z3, i + 1, j + 1, k + 1);
+
+    if constexpr (Derivatives) dx *= 32.0f, dy *= 32.0f;
+    return 32.0f * (n0 + n1 + n2 + n3);
+}
+
+floatv BatchNoise::simplex(floatv x, floatv y, floatv z) const
+{
+    floatv dx, dy;
+    return singleSimplex<false>(0, x * frequency, y * frequency, z * frequency, dx, dy);
+}
+
+floatv BatchNoise::simplex(floatv x, floatv y, floatv z, floatv& dx, floatv& dy) const
+{
+    auto value = singleSimplex<true>(0, x * frequency, y * frequency, z * frequency, dx, dy);
+    dx *= frequency;
+    dy *= frequency;
+    return value;
+}
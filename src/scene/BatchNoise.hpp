@@ -0,0 +1,46 @@
+#pragma once
+
+#include <FastNoise/FastNoise.h>
+#include <cstdint>
+#include "util/simd.hpp"
+
+namespace scene
+{
+    // Vectorized replica of the FastNoise functions the terrain uses. It does the very same
+    // operations in the very same order as the scalar library, so both give the same results
+    class BatchNoise final
+    {
+        using floatv = util::simd::floatv;
+        using intv = util::simd::intv;
+
+        std::int32_t perm[512];
+        float frequency, lacunarity, gain, fractalBounding;
+        int octaves;
+
+        // The gradient tables already indexed by perm12, to save a gather per lookup
+        float gradX[512], gradY[512], gradZ[512];
+
+        floatv gradCoord(intv lutPos, floatv xd, floatv yd, floatv zd) const;
+        template <bool Derivatives>
+        floatv singlePerlin(std::int32_t offset, floatv x, float y, float z, floatv& dx, floatv& dy) const;
+        template <bool Derivatives>
+        floatv sumOctaves(floatv x, float y, float z, floatv& dx, floatv& dy) const;
+        template <bool Derivatives>
+        floatv singleSimplex(std::int32_t offset, floatv x, floatv y, floatv z, floatv& dx, floatv& dy) const;
+
+    public:
+        BatchNoise() = default;
+        explicit BatchNoise(const FastNoise& noise);
+
+        // Same as FastNoise::GetPerlinFractal (FBM, quintic interpolation), but all the lanes share
+        // the same y and z, so the lattice hashing for them is done only once per batch
+        floatv perlinFractal(floatv x, float y, float z) const;
+
+        // Same as FastNoise::GetSimplex
+        floatv simplex(floatv x, floatv y, floatv z) const;
+
+        // The same values, along with their analytic partial derivatives in x and y
+        floatv perlinFractal(floatv x, float y, float z, floatv& dx, floatv& dy) const;
+        floatv simplex(floatv x, floatv y, floatv z, floatv& dx, floatv& dy) const;
+    };
+}
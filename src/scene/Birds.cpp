@@ -4,9 +4,11 @@
 #include <glm/gtx/norm.hpp>
 #include <random>
 #include <numeric>
+#include <limits>
 
 #include "resources/Cache.hpp"
 #include "util/range.hpp"
+#include "RenderLayers.hpp"
 
 constexpr float AnimationSpeed = 6;
 constexpr int MinBirds = 8, MaxBirds = 24;
@@ -16,6 +18,9 @@ constexpr float PointPerturbation = 16;
 constexpr float MaxHeight = 180;
 constexpr float BirdSpeed = 18;
 
+// Radius of a sphere around the origin of the model that holds the whole bird, wings spread
+constexpr float BirdRadius = 8;
+
 #ifdef _WIN32
 #include <execution>
 #define POLICY std::execution::par_unseq, 
@@ -30,6 +35,7 @@ Birds::Birds(const Terrain& terrain, int seed, float xmin, float zmin, float xma
 {
     // Load the bird model
     birdModel = cache::load<model::Model>("resources/models/bird/scene.gltf");
+    Lighting::setupProgram(*birdModel->program);
 
     std::mt19937 random(seed);
 
@@ -96,23 +102,31 @@ void Birds::update(const Terrain& terrain, double delta)
 
 void Birds::setClipPlane(const glm::vec4& plane)
 {
+    clipPlane = plane;
     birdModel->program->setUniform("ClipPlane", plane);
 }
 
-void Birds::draw(const glm::mat4& projection, const glm::mat4& view, const Lighting& lighting)
+void Birds::draw(gl::RenderQueue& queue, const glm::mat4& view)
 {
-    birdModel->program->use();
-    lighting.setLightParams(*birdModel->program, view);
-    birdModel->program->setUniform("Projection", projection);
-    birdModel->program->setUniform("View", view);
-
+    birdTransforms.clear();
+    float nearest = std::numeric_limits<float>::infinity();
     for (std::size_t i = 0; i < birdPaths.size(); i++)
     {
         auto pos = birdPositions[i];
         auto vel = birdVelocities[i];
-        birdModel->draw(glm::inverse(glm::lookAt(pos, pos - vel, glm::vec3(0, 1, 0))));
+
+        // The clip plane is normalized, so this is the distance to it
+        if (glm::dot(clipPlane, glm::vec4(pos, 1)) < -BirdRadius) continue;
+
+        birdTransforms.push_back(glm::inverse(glm::lookAt(pos, pos - vel, glm::vec3(0, 1, 0))));
+        nearest = std::min(nearest, -(view * glm::vec4(pos, 1)).z);
     }
-    
+
+    if (birdTransforms.empty()) return;
+    birdInstances.setInstances(birdTransforms);
+
+    // The model binds its materials itself
+    queue.submit(OpaqueLayer, *birdModel->program, nearest, [this] { birdModel->draw(birdInstances); }, {}, true);
 }
 
 glm::vec3 Birds::birdPosition(const std::vector<glm::vec3>& points, float t) const
@@ -22,6 +22,13 @@ namespace scene
         std::vector<glm::vec3> birdPositions;
         std::vector<glm::vec3> birdVelocities;
 
+        // The birds entirely on the negative side are culled (the default keeps everything)
+        glm::vec4 clipPlane = glm::vec4(0, 0, 0, 1);
+
+        // The birds left in the last draw, all drawn in one go since they share the pose
+        std::vector<glm::mat4> birdTransforms;
+        gl::InstanceSet birdInstances;
+
     public:
         Birds() = default;
         Birds(const Terrain& terrain, int seed, float xmin, float zmin, float xmax, float zmax);
@@ -29,7 +36,8 @@ namespace scene
         void update(const Terrain& terrain, double delta);
 
         void setClipPlane(const glm::vec4& plane);
-        void draw(const glm::mat4& projection, const glm::mat4& view, const Lighting& lighting);
+        // The queue must be executed before the next draw
+        void draw(gl::RenderQueue& queue, const glm::mat4& view);
 
         glm::vec3 birdPosition(const std::vector<glm::vec3>& points, float t) const;
         glm::vec3 birdVelocity(const std::vector<glm::vec3>& points, float t) const;
@@ -7,6 +7,13 @@ using namespace scene;
 
 constexpr float Edge = 8;
 
+Lighting::Lighting() : lightDirection(0, -1, 0)
+{
+    shadowMap.viewProjection = glm::mat4(1.0);
+    ShadowBlock shadow = { shadowMap.viewProjection };
+    shadowBuffer.upload(&shadow, sizeof(shadow));
+}
+
 Lighting::Lighting(float xmin, float ymin, float zmin, float xmax, float ymax, float zmax, float resolution,
     glm::vec3 lightDirection) : lightDirection(lightDirection)
 {
@@ -41,6 +48,8 @@ Lighting::Lighting(float xmin, float ymin, float zmin, float xmax, float ymax, f
     // Generate the orthographic projection
     auto proj = glm::ortho(min.x - Edge, max.x + Edge, min.y - Edge, max.x + Edge, min.z - Edge, max.z + Edge);
     shadowMap.viewProjection = proj * view;
+    ShadowBlock shadow = { shadowMap.viewProjection };
+    shadowBuffer.upload(&shadow, sizeof(shadow));
 
     // Create the depth texture
     shadowMap.width = std::ceil((max.x - min.x) / resolution);
@@ -67,18 +76,31 @@ glm::mat4 Lighting::getShadowProjection() const
     return shadowMap.viewProjection;
 }
 
-void Lighting::setLightParams(gl::Program& program, const glm::mat4& view) const
+void Lighting::setupProgram(gl::Program& program)
+{
+    program.bindUniformBlock("CameraBlock", CameraBinding);
+    program.bindUniformBlock("LightBlock", LightBinding);
+    program.bindUniformBlock("ShadowBlock", ShadowBinding);
+    program.setUniform("ShadowMapTexture", int(ShadowMapUnit));
+}
+
+void Lighting::setPass(const glm::mat4& projection, const glm::mat4& view)
 {
-    program.setUniform("Material.specularColor", glm::vec3(0.25, 0.25, 0.25));
-    program.setUniform("Material.shininess", 4.5f);
-    program.setUniform("Light.ambient", glm::vec3(0.25, 0.25, 0.25));
-    program.setUniform("Light.diffuse", glm::vec3(0.625, 0.625, 0.625));
-    program.setUniform("Light.specular", glm::vec3(1.0, 1.0, 1.0));
-    program.setUniform("Light.directionView", glm::normalize(glm::mat3(view) * lightDirection));
-    program.setUniform("ShadowViewProjection", shadowMap.viewProjection);
-
-    shadowMap.depthTexture.bindTo(5);
-    program.setUniform("ShadowMapTexture", 5);
+    cameraBuffer.update(CameraBlock{ projection, view });
+
+    LightBlock light;
+    light.directionView = glm::vec4(glm::normalize(glm::mat3(view) * lightDirection), 0);
+    light.ambient = glm::vec4(0.25, 0.25, 0.25, 0);
+    light.diffuse = glm::vec4(0.625, 0.625, 0.625, 0);
+    light.specular = glm::vec4(1.0, 1.0, 1.0, 0);
+    light.specularColor = glm::vec3(0.25, 0.25, 0.25);
+    light.shininess = 4.5f;
+    lightBuffer.update(light);
+
+    cameraBuffer.bindTo(CameraBinding);
+    lightBuffer.bindTo(LightBinding);
+    shadowBuffer.bindTo(ShadowBinding);
+    shadowMap.depthTexture.bindTo(ShadowMapUnit);
 }
 
 void Lighting::beginShadow()
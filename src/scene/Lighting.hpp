@@ -3,6 +3,7 @@
 #include "resources/Program.hpp"
 #include "resources/Texture.hpp"
 #include "resources/Framebuffer.hpp"
+#include "resources/UniformBuffer.hpp"
 #include <memory>
 
 namespace scene
@@ -21,13 +22,43 @@ namespace scene
 
         glm::vec3 lightDirection;
 
+        // The blocks of resources/shaders/blocks.glsl, laid out as std140
+        struct CameraBlock
+        {
+            glm::mat4 projection, view;
+        };
+
+        struct LightBlock
+        {
+            glm::vec4 directionView, ambient, diffuse, specular;
+            glm::vec3 specularColor;
+            float shininess;
+        };
+
+        struct ShadowBlock
+        {
+            glm::mat4 viewProjection;
+        };
+
+        gl::UniformBuffer cameraBuffer, lightBuffer, shadowBuffer;
+
     public:
-        Lighting() = default;
+        // The points the blocks are bound to, and the unit of the shadow map
+        enum : GLuint { CameraBinding, LightBinding, ShadowBinding };
+        static constexpr GLuint ShadowMapUnit = 5;
+
+        // Without shadows, with the light straight down
+        Lighting();
         Lighting(float xmin, float ymin, float zmin, float xmax, float ymax, float zmax, float resolution, 
             glm::vec3 lightDirection);
 
         glm::mat4 getShadowProjection() const;
-        void setLightParams(gl::Program& program, const glm::mat4& view) const;
+
+        // Point the blocks and the shadow map of a program that includes blocks.glsl to what setPass binds; once per program
+        static void setupProgram(gl::Program& program);
+
+        // Upload the camera and the light of a pass for all the programs at once, and bind the shadow map
+        void setPass(const glm::mat4& projection, const glm::mat4& view);
 
         void beginShadow();
         void endShadow();
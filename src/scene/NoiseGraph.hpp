@@ -0,0 +1,363 @@
+#pragma once
+
+#include <FastNoise/FastNoise.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "BatchNoise.hpp"
+#include "util/simd.hpp"
+
+// Height functions written as expressions of noise nodes, like
+//
+//     terrace(max(160.0f * scale(perlinFractal(0), 0.7f) + 20.0f, -20.0f), 20.0f, 140.0f)
+//
+// Each expression has its own type, so evaluating it compiles to a single kernel with every node inlined and
+// no dispatch at all. A graph can be evaluated on one point (with FastNoise) or on a batch of points sharing
+// the same y (with BatchNoise), and the batches can carry the partial derivatives in x and y along
+namespace scene::noise
+{
+    using util::simd::floatv;
+
+    // The noise functions behind the sources of a graph, which must have the same seed and settings
+    struct Sources
+    {
+        const FastNoise& scalar;
+        const BatchNoise& batch;
+    };
+
+    // A batch of values, with their derivatives in x and y when they are asked for (otherwise left undefined)
+    struct Batch
+    {
+        floatv value, dx, dy;
+    };
+
+    // Every node derives from this, so the operators below only pick up nodes. A node provides
+    //     float operator()(const Sources&, float x, float y) const;
+    //     template <bool Derivatives> Batch batch(const Sources&, floatv x, float y) const;
+    template <typename Derived>
+    struct Node
+    {
+        const Derived& derived() const { return static_cast<const Derived&>(*this); }
+    };
+
+    // Sources
+
+    struct Constant : Node<Constant>
+    {
+        float c;
+
+        float operator()(const Sources&, float, float) const { return c; }
+
+        template <bool Derivatives>
+        Batch batch(const Sources&, floatv, float) const { return { c, 0.0f, 0.0f }; }
+    };
+
+    // FastNoise::GetPerlinFractal, on the plane at the given z
+    struct PerlinFractal : Node<PerlinFractal>
+    {
+        float z;
+
+        float operator()(const Sources& sources, float x, float y) const { return sources.scalar.GetPerlinFractal(x, y, z); }
+
+        template <bool Derivatives>
+        Batch batch(const Sources& sources, floatv x, float y) const
+        {
+            Batch r;
+            if constexpr (Derivatives) r.value = sources.batch.perlinFractal(x, y, z, r.dx, r.dy);
+            else r.value = sources.batch.perlinFractal(x, y, z);
+            return r;
+        }
+    };
+
+    // FastNoise::GetSimplex, on the plane at the given z
+    struct Simplex : Node<Simplex>
+    {
+        float z;
+
+        float operator()(const Sources& sources, float x, float y) const { return sources.scalar.GetSimplex(x, y, z); }
+
+        template <bool Derivatives>
+        Batch batch(const Sources& sources, floatv x, float y) const
+        {
+            Batch r;
+            if constexpr (Derivatives) r.value = sources.batch.simplex(x, y, z, r.dx, r.dy);
+            else r.value = sources.batch.simplex(x, y, z);
+            return r;
+        }
+    };
+
+    // Transforms
+
+    // The node sampled at (x * s, y * s), so s > 1 makes its features smaller
+    template <typename A>
+    struct Scale : Node<Scale<A>>
+    {
+        A a;
+        float s;
+
+        float operator()(const Sources& sources, float x, float y) const { return a(sources, x * s, y * s); }
+
+        template <bool Derivatives>
+        Batch batch(const Sources& sources, floatv x, float y) const
+        {
+            auto r = a.template batch<Derivatives>(sources, x * s, y * s);
+            if constexpr (Derivatives)
+            {
+                r.dx = r.dx * s;
+                r.dy = r.dy * s;
+            }
+            return r;
+        }
+    };
+
+    template <typename A, typename B>
+    struct Add : Node<Add<A, B>>
+    {
+        A a;
+        B b;
+
+        float operator()(const Sources& sources, float x, float y) const { return a(sources, x, y) + b(sources, x, y); }
+
+        template <bool Derivatives>
+        Batch batch(const Sources& sources, floatv x, float y) const
+        {
+            auto ra = a.template batch<Derivatives>(sources, x, y);
+            auto rb = b.template batch<Derivatives>(sources, x, y);
+            if constexpr (Derivatives) return { ra.value + rb.value, ra.dx + rb.dx, ra.dy + rb.dy };
+            else return { ra.value + rb.value, 0.0f, 0.0f };
+        }
+    };
+
+    template <typename A, typename B>
+    struct Multiply : Node<Multiply<A, B>>
+    {
+        A a;
+        B b;
+
+        float operator()(const Sources& sources, float x, float y) const { return a(sources, x, y) * b(sources, x, y); }
+
+        template <bool Derivatives>
+        Batch batch(const Sources& sources, floatv x, float y) const
+        {
+            auto ra = a.template batch<Derivatives>(sources, x, y);
+            auto rb = b.template batch<Derivatives>(sources, x, y);
+            if constexpr (Derivatives)
+                return { ra.value * rb.value, ra.dx * rb.value + ra.value * rb.dx, ra.dy * rb.value + ra.value * rb.dy };
+            else return { ra.value * rb.value, 0.0f, 0.0f };
+        }
+    };
+
+    // The node plus a constant, without the work of adding zero derivatives
+    template <typename A>
+    struct Offset : Node<Offset<A>>
+    {
+        A a;
+        float c;
+
+        float operator()(const Sources& sources, float x, float y) const { return a(sources, x, y) + c; }
+
+        template <bool Derivatives>
+        Batch batch(const Sources& sources, floatv x, float y) const
+        {
+            auto r = a.template batch<Derivatives>(sources, x, y);
+            r.value = r.value + c;
+            return r;
+        }
+    };
+
+    // The node times a constant
+    template <typename A>
+    struct Amplify : Node<Amplify<A>>
+    {
+        A a;
+        float k;
+
+        float operator()(const Sources& sources, float x, float y) const { return k * a(sources, x, y); }
+
+        template <bool Derivatives>
+        Batch batch(const Sources& sources, floatv x, float y) const
+        {
+            auto r = a.template batch<Derivatives>(sources, x, y);
+            r.value = k * r.value;
+            if constexpr (Derivatives)
+            {
+                r.dx = k * r.dx;
+                r.dy = k * r.dy;
+            }
+            return r;
+        }
+    };
+
+    // The node clamped from below (Lower) or above; the clamped parts are flat
+    template <typename A, bool Lower>
+    struct Clamp : Node<Clamp<A, Lower>>
+    {
+        A a;
+        float limit;
+
+        float operator()(const Sources& sources, float x, float y) const
+        {
+            auto v = a(sources, x, y);
+            return Lower ? std::max(v, limit) : std::min(v, limit);
+        }
+
+        template <bool Derivatives>
+        Batch batch(const Sources& sources, floatv x, float y) const
+        {
+            auto r = a.template batch<Derivatives>(sources, x, y);
+            if constexpr (Derivatives)
+            {
+                auto clamped = Lower ? r.value < limit : r.value > limit;
+                r.dx = select(clamped, floatv(0.0f), r.dx);
+                r.dy = select(clamped, floatv(0.0f), r.dy);
+            }
+            r.value = Lower ? max(r.value, limit) : min(r.value, limit);
+            return r;
+        }
+    };
+
+    // Terraces: the heights get flat steps every levelHeight, with a smooth rise over the last quarter of each
+    // level, up to maxHeight (the heights above it are left as they are)
+    namespace terracing
+    {
+        constexpr float Pi = 3.14159265359f;
+        constexpr float KernelSize = 0.25f;
+
+        inline float flattenFunction(float x)
+        {
+            if (x < 1 - KernelSize) return 0;
+            return 0.5f + 0.5f * std::sin(Pi * (x - (1 - KernelSize / 2)) / KernelSize);
+        }
+
+        inline float flattener(float x, float levelHeights, float maxHeight)
+        {
+            if (x > maxHeight) return x;
+
+            float v = x / levelHeights;
+            float nv = std::floor(v) + flattenFunction(v - std::floor(v));
+            return nv * levelHeights;
+        }
+
+        // Vectorized version, with the sin replaced by a polynomial, and optionally its derivative
+        inline floatv flattener(floatv x, float levelHeights, float maxHeight, floatv* derivative)
+        {
+            using namespace util::simd;
+
+            auto v = x / levelHeights;
+            auto fv = floor(v);
+            auto f = v - fv;
+
+            // The argument of the sin here is always inside [-pi/2, pi/2)
+            auto angle = Pi * (f - (1 - KernelSize / 2)) / KernelSize;
+            auto terrace = f < 1 - KernelSize;
+            auto flatten = select(terrace, floatv(0.0f), 0.5f + 0.5f * sinHalfPeriod(angle));
+
+            // The level heights cancel out: this is just the slope of flattenFunction
+            if (derivative)
+            {
+                auto slope = select(terrace, floatv(0.0f), (0.5f * Pi / KernelSize) * cosHalfPeriod(angle));
+                *derivative = select(x > maxHeight, floatv(1.0f), slope);
+            }
+
+            return select(x > maxHeight, x, (fv + flatten) * levelHeights);
+        }
+    }
+
+    template <typename A>
+    struct Terrace : Node<Terrace<A>>
+    {
+        A a;
+        float levelHeight, maxHeight;
+
+        float operator()(const Sources& sources, float x, float y) const
+        {
+            return terracing::flattener(a(sources, x, y), levelHeight, maxHeight);
+        }
+
+        template <bool Derivatives>
+        Batch batch(const Sources& sources, floatv x, float y) const
+        {
+            auto r = a.template batch<Derivatives>(sources, x, y);
+            floatv slope;
+            r.value = terracing::flattener(r.value, levelHeight, maxHeight, Derivatives ? &slope : nullptr);
+            if constexpr (Derivatives)
+            {
+                r.dx = r.dx * slope;
+                r.dy = r.dy * slope;
+            }
+            return r;
+        }
+    };
+
+    // Building the graphs
+
+    inline Constant constant(float c) { return { {}, c }; }
+    inline PerlinFractal perlinFractal(float z) { return { {}, z }; }
+    inline Simplex simplex(float z) { return { {}, z }; }
+
+    template <typename A>
+    Scale<A> scale(const Node<A>& a, float s) { return { {}, a.derived(), s }; }
+
+    template <typename A, typename B>
+    Add<A, B> operator+(const Node<A>& a, const Node<B>& b) { return { {}, a.derived(), b.derived() }; }
+
+    template <typename A, typename B>
+    Multiply<A, B> operator*(const Node<A>& a, const Node<B>& b) { return { {}, a.derived(), b.derived() }; }
+
+    template <typename A>
+    Offset<A> operator+(const Node<A>& a, float c) { return { {}, a.derived(), c }; }
+    template <typename A>
+    Offset<A> operator+(float c, const Node<A>& a) { return { {}, a.derived(), c }; }
+    template <typename A>
+    Offset<A> operator-(const Node<A>& a, float c) { return { {}, a.derived(), -c }; }
+
+    template <typename A>
+    Amplify<A> operator*(const Node<A>& a, float k) { return { {}, a.derived(), k }; }
+    template <typename A>
+    Amplify<A> operator*(float k, const Node<A>& a) { return { {}, a.derived(), k }; }
+    template <typename A>
+    Amplify<A> operator-(const Node<A>& a) { return { {}, a.derived(), -1.0f }; }
+
+    template <typename A>
+    Clamp<A, true> max(const Node<A>& a, float limit) { return { {}, a.derived(), limit }; }
+    template <typename A>
+    Clamp<A, false> min(const Node<A>& a, float limit) { return { {}, a.derived(), limit }; }
+    template <typename A>
+    auto clamp(const Node<A>& a, float low, float high) { return min(max(a, low), high); }
+
+    template <typename A>
+    Terrace<A> terrace(const Node<A>& a, float levelHeight, float maxHeight = std::numeric_limits<float>::infinity())
+    {
+        return { {}, a.derived(), levelHeight, maxHeight };
+    }
+
+    // Evaluation of a whole graph on count samples of the grid row j, starting at column i, where the sample (i, j)
+    // is at (i * resolution, j * resolution); the derivatives are only computed and written if dx and dy are given
+    template <typename Graph>
+    void sampleRow(const Graph& graph, const Sources& sources, std::ptrdiff_t i, std::ptrdiff_t j, float resolution,
+        float* out, float* dx, float* dy, std::size_t count)
+    {
+        using namespace util::simd;
+        float y = j * resolution;
+
+        if (dx && dy)
+        {
+            for (std::size_t k = 0; k < count; k += Width)
+            {
+                floatv x = toFloat(intv(std::int32_t(i + k)) + iota()) * resolution;
+                auto r = graph.template batch<true>(sources, x, y);
+                storePartial(out + k, r.value, count - k);
+                storePartial(dx + k, r.dx, count - k);
+                storePartial(dy + k, r.dy, count - k);
+            }
+        }
+        else
+        {
+            for (std::size_t k = 0; k < count; k += Width)
+            {
+                floatv x = toFloat(intv(std::int32_t(i + k)) + iota()) * resolution;
+                storePartial(out + k, graph.template batch<false>(sources, x, y).value, count - k);
+            }
+        }
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace scene
+{
+    // The order of the parts of a pass in the render queue: the sky first (without writing depth), then the clouds
+    // blended over it, then the opaque geometry
+    enum RenderLayer : std::uint8_t
+    {
+        SkyLayer, CloudLayer, OpaqueLayer
+    };
+}
@@ -23,17 +23,33 @@ using namespace scene;
 
 constexpr float TerrainWidth = 512;
 constexpr float TerrainHeight = 512;
+const std::filesystem::path TerrainCacheDirectory = "cache/terrain";
+
+// Well under what can be seen from the camera, but enough to drop most of the vertices of the terraces
+constexpr float TerrainSimplificationError = 0.05f;
 
 const glm::vec3 LightDirection = glm::normalize(glm::vec3(1, -1, -1));
 
-Scene::Scene(glfw::Window& window) : window(window), time(0), camera(window, std::hypot(TerrainWidth, TerrainHeight))
+// A clip plane that keeps everything, set back after the water passes so the others cull nothing against it
+const glm::vec4 NoClipPlane = glm::vec4(0, 0, 0, 1);
+
+Scene::Scene(glfw::Window& window, bool streamTerrain, std::optional<int> terrainSeed, std::size_t chunkCells)
+    : window(window), time(0), camera(window, std::hypot(TerrainWidth, TerrainHeight))
 {
     std::random_device random{};
 
     skyDome = SkyDome(32);
     skyDome.setColors(colors::LightBlue, colors::Blue);
     skyClouds = SkyClouds(500, random());
-    terrain = Terrain(TerrainWidth, TerrainHeight, 0.5, random());
+
+    // Only a fixed seed can be found again, so it's the only case worth caching the terrain tiles
+    int seed = terrainSeed ? *terrainSeed : int(random());
+    auto cacheDirectory = terrainSeed ? TerrainCacheDirectory : std::filesystem::path();
+    auto& pool = util::thread_pool::global();
+    if (streamTerrain) terrain = Terrain(0.5, seed, TerrainStreaming(), camera.position, pool, cacheDirectory, chunkCells);
+    else terrain = Terrain(TerrainWidth, TerrainHeight, 0.5, seed, pool, cacheDirectory, chunkCells);
+    terrain.setSimplification(TerrainSimplificationError, pool);
+
     water = Water(0, -TerrainWidth / 2, -TerrainHeight / 2, TerrainWidth / 2, TerrainHeight / 2, window.getFramebufferSize(), random());
 
     birds = Birds(terrain, random(), -TerrainWidth / 2, -TerrainHeight / 2, TerrainWidth / 2, TerrainHeight / 2);
@@ -54,6 +70,8 @@ void Scene::update(double delta)
 {
     time += delta;
     camera.update(window, delta);
+    terrain.stream(camera.position, camera.projection * camera.getViewMatrix());
+    terrain.setLodCenter(camera.position);
     skyClouds.update(delta);
     terrain.update(delta);
     birds.update(terrain, delta);
@@ -76,6 +94,20 @@ void Scene::draw(double delta)
     {
         ImGui::Begin("Performance counter", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize);
         ImGui::Text("GPU query timer: %2lu.%04lu ms", value / 1000000, (value / 100) % 10000);
+        ImGui::Text("Terrain chunks: %zu (%.1f MiB)", terrain.getResidentChunks(), terrain.getMemoryUsage() / 1048576.0);
+
+        // Triangles of the terrain actually drawn in each pass, against the full resolution count
+        static const char* passNames[] = { "shadow", "main", "reflection", "refraction" };
+        for (std::size_t pass = 0; pass < NumPasses; pass++)
+        {
+            const auto& culling = terrainCulling[pass];
+            ImGui::Text("Terrain triangles (%s): %zu / %zu", passNames[pass], terrainTriangles[pass].first, terrainTriangles[pass].second);
+            ImGui::Text("  chunks: %zu drawn, %zu outside, %zu occluded; trees: %zu drawn, %zu outside, %zu occluded",
+                culling.chunksDrawn, culling.chunksOutside, culling.chunksOccluded,
+                culling.treesDrawn, culling.treesOutside, culling.treesOccluded);
+        }
+        ImGui::Text("Render queue: %zu items, %zu program binds, %zu texture binds, %zu binds saved", frameQueueStats.items,
+            frameQueueStats.programBinds, frameQueueStats.textureBinds, frameQueueStats.bindsSaved);
         ImGui::End();
     }
 
@@ -84,6 +116,7 @@ void Scene::draw(double delta)
     // Draw the shadow map
     lighting.beginShadow();
     drawScene(lighting.getShadowProjection(), glm::mat4(1.0), false);
+    recordTerrainStats(ShadowPass);
     lighting.endShadow();
     window.setViewport();
 
@@ -94,7 +127,11 @@ void Scene::draw(double delta)
     glClearDepth(1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // Only the main pass is culled against the terrain: the others see it from elsewhere or clip part of it away
+    terrain.enableOcclusion(camera.position, camera.projection * view);
     drawScene(camera.projection, view);
+    terrain.disableOcclusion();
+    recordTerrainStats(MainPass);
 
     // Check for water occlusion
     water.checkOcclusion(camera.projection, view);
@@ -106,6 +143,7 @@ void Scene::draw(double delta)
         terrain.setClipPlane(water.getReflectionClipPlane());
         birds.setClipPlane(water.getReflectionClipPlane());
         drawScene(camera.projection, view * water.getReflectionMatrix());
+        recordTerrainStats(ReflectionPass);
         water.endReflection();
 
         // Draw the water refraction
@@ -113,23 +151,44 @@ void Scene::draw(double delta)
         terrain.setClipPlane(water.getRefractionClipPlane());
         birds.setClipPlane(water.getRefractionClipPlane());
         drawScene(camera.projection, view, false);
+        recordTerrainStats(RefractionPass);
         water.endRefraction();
+        terrain.setClipPlane(NoClipPlane);
+        birds.setClipPlane(NoClipPlane);
 
         gl::Framebuffer::bindDefault();
-        water.draw(camera.projection, view);
+        lighting.setPass(camera.projection, view);
+        water.draw(view);
+    }
+    else
+    {
+        terrainTriangles[ReflectionPass] = terrainTriangles[RefractionPass] = {};
+        terrainCulling[ReflectionPass] = terrainCulling[RefractionPass] = {};
     }
     queries.back().end();
+
+    frameQueueStats = queueStats;
+    queueStats = {};
+}
+
+void Scene::recordTerrainStats(std::size_t pass)
+{
+    terrainTriangles[pass] = { terrain.getTrianglesDrawn(), terrain.getFullResolutionTriangles() };
+    terrainCulling[pass] = terrain.getCullStats();
 }
 
 void Scene::drawScene(const glm::mat4& projection, const glm::mat4& view, bool drawDome)
 {
     if (drawDome)
     {
-        skyDome.draw(camera.infiniteProjection, view);
-        skyClouds.draw(camera.infiniteProjection, view);
+        skyDome.draw(renderQueue, camera.infiniteProjection, view);
+        skyClouds.draw(renderQueue, camera.infiniteProjection, view);
     }
 
-    // Set the terrain parameters
-    terrain.draw(projection, view, lighting);
-    birds.draw(projection, view, lighting);
+    lighting.setPass(projection, view);
+    terrain.draw(renderQueue, projection, view);
+    birds.draw(renderQueue, view);
+
+    renderQueue.execute();
+    queueStats += renderQueue.getStats();
 }
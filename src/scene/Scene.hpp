@@ -1,9 +1,11 @@
 #pragma once
 
+#include <optional>
 #include "wrappers/glfw.hpp"
 #include "resources/Program.hpp"
 #include "resources/FileUtils.hpp"
 #include "resources/Mesh.hpp"
+#include "resources/RenderQueue.hpp"
 
 #include "Lighting.hpp"
 #include "Terrain.hpp"
@@ -29,8 +31,23 @@ namespace scene
 
         float time;
 
+        // Terrain triangles drawn (and at full resolution) in each of the passes of the last frame, and what the
+        // culling did there
+        enum { ShadowPass, MainPass, ReflectionPass, RefractionPass, NumPasses };
+        std::pair<std::size_t, std::size_t> terrainTriangles[NumPasses] = {};
+        TerrainCullStats terrainCulling[NumPasses] = {};
+
+        // Every pass submits its draws here and executes them sorted; what the sorting saved, over the last frame
+        gl::RenderQueue renderQueue;
+        gl::RenderQueueStats queueStats = {}, frameQueueStats = {};
+
+        void recordTerrainStats(std::size_t pass);
+
     public:
-        Scene(glfw::Window& window);
+        // With streamTerrain, the terrain is paged in around the camera instead of being a fixed island;
+        // with a terrain seed, the terrain is the same on every run and cached on disk
+        Scene(glfw::Window& window, bool streamTerrain = false, std::optional<int> terrainSeed = {},
+            std::size_t chunkCells = Terrain::DefaultChunkCells);
         ~Scene();
 
         void update(double delta);
@@ -4,6 +4,9 @@
 #include <random>
 #include <FastNoise/FastNoise.h>
 #include "util/grid.hpp"
+#include "RenderLayers.hpp"
+#include "util/counter_rng.hpp"
+#include "util/texture_baker.hpp"
 
 using namespace scene;
 
@@ -13,12 +16,11 @@ constexpr float CloudSpeed = 0.0025f;
 static auto generateNoise(int seed)
 {
     // Generate a Perlin noise texture
-    std::mt19937 random(seed);
-    std::uniform_real_distribution dist(-1.0f, 1.0f);
+    util::counter_rng random(seed);
 
     constexpr int Width = 128, Height = 128;
     util::grid<float> image(Width, Height);
-    std::generate(image.begin(), image.end(), [&] { return dist(random); });
+    util::bake_texels(util::thread_pool::global(), image, [&](std::size_t i, std::size_t j) { return random.uniform(j * Width + i, -1.0f, 1.0f); });
 
     // Generate the texture
     gl::Texture2D texture;
@@ -40,6 +42,7 @@ SkyClouds::SkyClouds(float y, int seed) : skyY(y), time(0.0)
         "resources/shaders/clouds.vert",
         "resources/shaders/clouds.frag"
     });
+    displacementUniform = cloudProgram->getUniform<glm::vec2>("Displacement");
 
     cloudMesh = gl::Mesh::empty();
     
@@ -58,36 +61,39 @@ void SkyClouds::update(double delta)
     time += delta;
 }
 
-void SkyClouds::draw(const glm::mat4& projection, const glm::mat4& view)
+void SkyClouds::draw(gl::RenderQueue& queue, const glm::mat4& projection, const glm::mat4& view)
 {
     // Regenerate the mesh
     regenerateMesh(projection * view);
 
     // And then prepare the program to draw
-    cloudProgram->use();
     cloudProgram->setUniform("Projection", projection);
     cloudProgram->setUniform("View", view);
     cloudProgram->setUniform("TextureScale", 16384.0f);
     cloudProgram->setUniform("DistanceFalloff", 131072.0f);
+    cloudProgram->setUniform("CloudTexture", 0);
 
-    // Draw the mesh using alpha blending
-    glEnable(GL_DEPTH_CLAMP);
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_DEPTH_TEST);
-
-    for (std::size_t i = 0; i < std::size(cloudTextures); i++)
+    // The layers are blended in order, so they are a single item
+    queue.submit(CloudLayer, *cloudProgram, 0, [this]
     {
-        cloudTextures[i].bindTo(0);
-        cloudProgram->setUniform("CloudTexture", 0);
-        cloudProgram->setUniform("Displacement", time * displacements[i]);
-        cloudMesh.draw(glm::mat4(1.0));
-    }
-
-    glEnable(GL_DEPTH_TEST);
-    glDisable(GL_BLEND);
-    glDisable(GL_DEPTH_CLAMP);
+        // Draw the mesh using alpha blending
+        glEnable(GL_DEPTH_CLAMP);
+        glEnable(GL_BLEND);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_DEPTH_TEST);
+
+        for (std::size_t i = 0; i < std::size(cloudTextures); i++)
+        {
+            cloudTextures[i].bindTo(0);
+            displacementUniform.set(time * displacements[i]);
+            cloudMesh.draw(glm::mat4(1.0));
+        }
+
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glDisable(GL_DEPTH_CLAMP);
+    }, {}, true);
 }
 
 static auto pointAtScreenCoord(glm::vec2 coord, float y0, const glm::mat4& viewProj)
@@ -3,6 +3,7 @@
 #include "resources/Mesh.hpp"
 #include "resources/Program.hpp"
 #include "resources/Texture.hpp"
+#include "resources/RenderQueue.hpp"
 
 namespace scene
 {
@@ -11,6 +12,7 @@ namespace scene
         // The (variable) sky mesh put on the sky
         gl::Mesh cloudMesh;
         std::shared_ptr<gl::Program> cloudProgram;
+        gl::Uniform<glm::vec2> displacementUniform;
         gl::Texture2D cloudTextures[3];
         glm::vec2 displacements[3];
 
@@ -23,6 +25,6 @@ namespace scene
         void update(double delta);
 
         void regenerateMesh(const glm::mat4& viewProj);
-        void draw(const glm::mat4& projection, const glm::mat4& view);
+        void draw(gl::RenderQueue& queue, const glm::mat4& projection, const glm::mat4& view);
     };
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "mesh_utils.hpp"
 #include "colors.hpp"
 #include "resources/Cache.hpp"
+#include "RenderLayers.hpp"
 
 #include <glm/gtx/transform.hpp>
 
@@ -28,12 +29,9 @@ SkyDome::SkyDome(std::size_t numDivs)
     domeProgram->setName("Dome Program");
 }
 
-void SkyDome::draw(const glm::mat4& projection, const glm::mat4& view)
+void SkyDome::draw(gl::RenderQueue& queue, const glm::mat4& projection, const glm::mat4& view)
 {
-    glDepthMask(GL_FALSE);
-
     // Use the program
-    domeProgram->use();
     domeProgram->setUniform("Projection", projection);
     domeProgram->setUniform("SphereRadius", SphereRadius);
 
@@ -42,7 +40,10 @@ void SkyDome::draw(const glm::mat4& projection, const glm::mat4& view)
     domeProgram->setUniform("View", glm::translate(-trans) * view);
 
     // Now, draw the mesh
-    sphereMesh.draw(glm::mat4(1.0));
-
-    glDepthMask(GL_TRUE);
+    queue.submit(SkyLayer, *domeProgram, 0, [this]
+    {
+        glDepthMask(GL_FALSE);
+        sphereMesh.draw(glm::mat4(1.0));
+        glDepthMask(GL_TRUE);
+    });
 }
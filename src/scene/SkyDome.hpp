@@ -3,6 +3,7 @@
 #include <memory>
 #include "resources/Mesh.hpp"
 #include "resources/Program.hpp"
+#include "resources/RenderQueue.hpp"
 
 namespace scene
 {
@@ -38,6 +39,6 @@ namespace scene
             domeProgram->setUniform("PinnacleColor", glm::vec4(pinnacleColor) / 255.0f);
         }
 
-        void draw(const glm::mat4& projection, const glm::mat4& view);
+        void draw(gl::RenderQueue& queue, const glm::mat4& projection, const glm::mat4& view);
     };
 }
@@ -2,13 +2,25 @@
 
 #include "colors.hpp"
 
-#include <thread>
 #include <random>
+#include <chrono>
 #include <algorithm>
+#include <iterator>
+#include <limits>
+#include <tuple>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include "resources/Cache.hpp"
 #include "util/Frustum.hpp"
 #include "util/range.hpp"
+#include "util/mapped_file.hpp"
+#include "util/simd.hpp"
+#include "util/counter_rng.hpp"
+#include "util/texture_baker.hpp"
 #include "mesh_utils.hpp"
+#include "RenderLayers.hpp"
 
 #include <glm/gtx/transform.hpp>
 
@@ -21,239 +33,718 @@
 
 using namespace scene;
 
-// This is so I can easily parallelize if necessary
-static std::mutex terrainMutex;
-
-constexpr std::make_signed_t<std::size_t> MaxCellDivision = 128;
+constexpr std::make_signed_t<std::size_t> RowsPerTask = 16;
 constexpr float Pi = 3.14159265359f;
 
-Terrain::Terrain(float width, float height, float resolution, int seed) : terrainFunction(width, height, seed),
-    resolution(resolution), time(0)
+// Each level of detail halves the resolution of the previous one
+constexpr std::make_signed_t<std::size_t> LodLevels = 6;
+constexpr float SkirtMargin = 0.25f;
+
+// Floor division, since the chunk coordinates can be negative
+static std::make_signed_t<std::size_t> floorDiv(std::make_signed_t<std::size_t> a, std::make_signed_t<std::size_t> b)
+{
+    auto d = a / b;
+    return d * b > a ? d - 1 : d;
+}
+
+// Every chunk gets its own seed, so it is the same no matter when or in which order the chunks are generated
+static std::uint64_t chunkSeed(std::uint64_t seed, std::int64_t ci, std::int64_t cj)
+{
+    // splitmix64 over the combination of the coordinates
+    std::uint64_t z = seed + 0x9E3779B97F4A7C15ull * (std::uint64_t(ci) * 0x632BE59BD9B4E019ull + std::uint64_t(cj) + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Octahedral encoding of a unit vector into two snorm16, with the pole on +Y where most of the terrain normals
+// are (decoded by terrain.vert)
+static glm::i16vec2 encodeNormal(const glm::vec3& n)
+{
+    auto p = glm::vec2(n.x, n.z) / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+    if (n.y < 0)
+        p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0 ? 1 : -1, p.y >= 0 ? 1 : -1);
+    return glm::i16vec2(glm::round(glm::clamp(p, -1.0f, 1.0f) * 32767.0f));
+}
+
+// Calls f(ci, cj, distance) for every chunk whose rectangle is closer than distance to the position on the XZ plane
+template <typename F>
+static void forEachChunkAround(const glm::vec3& position, float resolution, std::make_signed_t<std::size_t> chunkCells,
+    float distance, F&& f)
+{
+    using ssize = std::make_signed_t<std::size_t>;
+    float chunkSize = chunkCells * resolution;
+
+    // The j axis of the grid points to -z
+    float px = position.x, py = -position.z;
+    ssize cimin = std::floor((px - distance) / chunkSize), cimax = std::floor((px + distance) / chunkSize);
+    ssize cjmin = std::floor((py - distance) / chunkSize), cjmax = std::floor((py + distance) / chunkSize);
+
+    for (ssize cj = cjmin; cj <= cjmax; cj++)
+        for (ssize ci = cimin; ci <= cimax; ci++)
+        {
+            float dx = std::max({ ci * chunkSize - px, 0.0f, px - (ci + 1) * chunkSize });
+            float dy = std::max({ cj * chunkSize - py, 0.0f, py - (cj + 1) * chunkSize });
+            float d = std::hypot(dx, dy);
+            if (d <= distance) f(ci, cj, d);
+        }
+}
+
+Terrain::Terrain(float width, float height, float resolution, int seed, util::thread_pool& pool,
+    const std::filesystem::path& cacheDirectory, std::size_t chunkCells)
+    : terrainFunction(std::make_shared<TerrainFunction>(width, height, seed)), frame(0), memoryUsage(0),
+    globalMinHeight(std::numeric_limits<float>::infinity()), globalMaxHeight(-std::numeric_limits<float>::infinity()),
+    resolution(resolution), chunkCells(chunkCells), seed(seed), time(0)
+{
+    createResources(seed);
+    openCache(cacheDirectory, seed, width, height);
+
+    auto hw = ssize(0.5f * width / resolution);
+    auto hh = ssize(0.5f * height / resolution);
+
+    // Generate chunks of chunkCells x chunkCells cells, enough of them to cover [-hw, hw] x [-hh, hh]
+    auto cimin = floorDiv(-hw, this->chunkCells), cimax = floorDiv(hw - 1, this->chunkCells);
+    auto cjmin = floorDiv(-hh, this->chunkCells), cjmax = floorDiv(hh - 1, this->chunkCells);
+    auto divsX = cimax - cimin + 1, divsY = cjmax - cjmin + 1;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Each chunk is a task in the pool: it is loaded from the cache, or it samples its own region (with the slopes
+    // for the normals) and is built, so a few missing tiles only cost their own chunks. The sampling and the
+    // building split their rows into smaller tasks, so idle threads can steal from the last chunks being built
+    std::vector<Chunk> built(divsX * divsY);
+    util::task_group group;
+    for (ssize j = 0; j < divsY; j++)
+        for (ssize i = 0; i < divsX; i++)
+            pool.submit(group, [&, k = j * divsX + i, ci = cimin + i, cj = cjmin + j]
+            {
+                auto cells = this->chunkCells;
+                if (loadChunk(this->cacheDirectory, cacheKey, cells, ci, cj, built[k])) return;
+
+                auto samples = sampleRegion(pool, *terrainFunction, resolution, ci * cells, cj * cells, cells + 1, cells + 1);
+                built[k] = buildChunk(pool, samples, resolution, this->seed, cells, ci, cj);
+                saveChunk(this->cacheDirectory, cacheKey, built[k]);
+            });
+    pool.wait(group);
+
+    generationTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto& chunk : built) insertChunk(std::move(chunk));
+}
+
+Terrain::Terrain(float resolution, int seed, const TerrainStreaming& settings, const glm::vec3& center,
+    util::thread_pool& pool, const std::filesystem::path& cacheDirectory, std::size_t chunkCells)
+    : terrainFunction(std::make_shared<TerrainFunction>(0.0f, 0.0f, seed)),
+    streaming(std::make_unique<StreamingState>(settings, pool)), frame(0), memoryUsage(0),
+    globalMinHeight(std::numeric_limits<float>::infinity()), globalMaxHeight(-std::numeric_limits<float>::infinity()),
+    resolution(resolution), chunkCells(chunkCells), seed(seed), time(0)
+{
+    createResources(seed);
+    openCache(cacheDirectory, seed, 0, 0);
+
+    // The chunks around the starting point are generated right away, so the terrain can be used for the scene setup
+    auto start = std::chrono::steady_clock::now();
+    forEachChunkAround(center, resolution, this->chunkCells, settings.viewDistance,
+        [&](ssize ci, ssize cj, float) { scheduleChunk(ci, cj); });
+    pool.wait(streaming->tasks);
+    generationTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto& chunk : streaming->ready) insertChunk(std::move(chunk));
+    streaming->ready.clear();
+    streaming->inFlight.clear();
+}
+
+void Terrain::createResources(int seed)
 {
+    // The vertices of a chunk must fit 16-bit indices, and its coarsest level of detail must still have a cell
+    if (chunkCells < ssize(MinChunkCells) || chunkCells > ssize(MaxChunkCells) || (chunkCells & (chunkCells - 1)))
+        throw std::invalid_argument("Chunks must have a power of two of cells, from " + std::to_string(MinChunkCells)
+            + " to " + std::to_string(MaxChunkCells));
+
     // Create the programs
     terrainProgram = cache::loadProgram({
-        "resources/shaders/position.vert",
         "resources/shaders/lighting.frag",
         "resources/shaders/terrain.vert",
         "resources/shaders/terrain.frag" });
     terrainProgram->setName("Terrain Program");
+    Lighting::setupProgram(*terrainProgram);
+    chunkOriginUniform = terrainProgram->getUniform<glm::vec2>("ChunkOrigin");
+    heightRangeUniform = terrainProgram->getUniform<glm::vec2>("HeightRange");
 
     treesProgram = cache::loadProgram({
-        "resources/shaders/position.vert",
         "resources/shaders/lighting.frag",
         "resources/shaders/commonObjects.vert",
         "resources/shaders/commonObjects.frag" });
     treesProgram->setName("Common Objects Program");
+    Lighting::setupProgram(*treesProgram);
 
-    auto hw = ssize(0.5f * width / resolution);
-    auto hh = ssize(0.5f * height / resolution);
+    // Every chunk has the same topology, so they all share a single index list
+    std::vector<std::uint16_t> indices;
+    lods = buildTopology(chunkCells + 1, indices);
+    chunkElements = gl::ElementBuffer(indices);
+    chunkElements.setName("Terrain Elements");
+
+    // Create the tree mesh
+    trunkMesh = mesh_utils::openCylinder(glm::vec3(0, 0, 0), glm::vec3(0, 1, 0), 1, colors::CocoaBrown, 32);
+    coneMesh = mesh_utils::closedCone(glm::vec3(0, 0, 0), glm::vec3(0, 8, 0), 1, colors::DarkGreen, 32);
+    trunkMesh.setName("Trunk Mesh");
+    coneMesh.setName("Cone Mesh");
 
-    heights.resize(2 * hw + 1, 2 * hh + 1);
-    nys.resize(2 * hw + 1, 2 * hh + 1);
-    xofs = hw, yofs = hh;
+    std::mt19937 random(seed);
 
-    // Generate meshes spanning at most 128*128 triangles
-    auto divsX = (2 * hw + 1) / MaxCellDivision;
-    auto divsY = (2 * hh + 1) / MaxCellDivision;
+    // Generate the shearing parameters
+    constexpr float MaxShearingRadius = 0.25;
+    std::uniform_real_distribution radiusGen(0.0f, MaxShearingRadius);
+    shearingEllipse = glm::vec2(radiusGen(random), radiusGen(random));
+    shearingRotation = std::uniform_real_distribution(0.0f, 2 * Pi)(random);
 
-    maxHeight.resize(divsX, divsY);
-    minHeight.resize(divsX, divsY);
+    // Generate the dirt texture
+    generateDirtTexture(random());
+}
 
-    std::mt19937 engine(seed);
+std::uint64_t Terrain::chunkKey(ssize ci, ssize cj)
+{
+    return (std::uint64_t(std::uint32_t(ci)) << 32) | std::uint32_t(cj);
+}
 
-    // Simple paralellization
-    std::vector<std::thread> threads;
-    for (ssize j = 0; j < divsY; j++)
-        for (ssize i = 0; i < divsX; i++)
-        {
-            if (i == 0 && j == 0) continue;
+const Terrain::Chunk* Terrain::findChunk(ssize i, ssize j, ssize& li, ssize& lj) const
+{
+    auto ci = floorDiv(i, chunkCells), cj = floorDiv(j, chunkCells);
 
-            auto x1 = -hw + MaxCellDivision * i;
-            auto y1 = -hh + MaxCellDivision * j;
-            auto x2 = std::min(hw, -hw + MaxCellDivision * (i + 1));
-            auto y2 = std::min(hh, -hh + MaxCellDivision * (j + 1));
-            int seed = engine();
+    // The first sample of a chunk is also the last one of the previous chunk, which might be the only one resident
+    for (ssize di = 0; di <= (i == ci * chunkCells); di++)
+        for (ssize dj = 0; dj <= (j == cj * chunkCells); dj++)
+        {
+            auto it = chunks.find(chunkKey(ci - di, cj - dj));
+            if (it == chunks.end()) continue;
 
-            threads.push_back(std::thread([=, wi = i == divsX - 1, wj = j == divsY - 1]
-                { buildTerrain(x1, y1, x2, y2, seed, wi, wj); }));
+            li = i - (ci - di) * chunkCells;
+            lj = j - (cj - dj) * chunkCells;
+            return &it->second;
         }
 
-    buildTerrain(-hw, -hh, std::min(hw, -hw + MaxCellDivision), std::min(hh, -hh + MaxCellDivision), engine());
-    for (auto& thread : threads) thread.join();
+    return nullptr;
+}
 
-    for (auto& builder : temporaryBuilders)
+Terrain::SampledRegion Terrain::sampleRegion(util::thread_pool& pool, const TerrainFunction& function, float resolution,
+    ssize imin, ssize jmin, ssize width, ssize height)
+{
+    SampledRegion samples{ imin, jmin, util::grid<float>(width, height), util::grid<float>(width, height), util::grid<float>(width, height) };
+    pool.parallel_for(ssize(0), height, RowsPerTask, [&](ssize jb, ssize je)
     {
-        terrainMeshes.push_back(builder);
-        terrainMeshes.back().setName("Terrain Mesh " + std::to_string(terrainMeshes.size()));
-    }
+        for (auto j = jb; j < je; j++)
+            function.sampleRow(imin, jmin + j, resolution, &samples.heights(0, j), &samples.dxs(0, j), &samples.dys(0, j), width);
+    });
+
+    return samples;
+}
+
+Terrain::Chunk Terrain::buildChunk(util::thread_pool& pool, const SampledRegion& samples, float resolution,
+    std::uint64_t seed, ssize cells, ssize ci, ssize cj)
+{
+    ssize size = cells + 1;
 
-    temporaryBuilders.clear();
+    Chunk chunk;
+    chunk.ci = ci, chunk.cj = cj;
+    chunk.heights.resize(size, size);
+    chunk.nys.resize(size, size);
 
-    // Now, generate the mesh and the instances
-    buildTrees(engine());
+    auto xmin = ci * cells, ymin = cj * cells;
+    auto& mesh = chunk.builder;
 
-    // Compute the global min and max height
-    globalMinHeight = *std::min_element(minHeight.begin(), minHeight.end());
-    globalMaxHeight = *std::max_element(maxHeight.begin(), maxHeight.end());
+    // The samples are already computed, so this is only a matter of reading them
+    auto ioffset = xmin - samples.imin, joffset = ymin - samples.jmin;
 
-    // Generate the dirt texture
-    generateDirtTexture(engine());
+    // First, we're going to build the normals (the heights are quantized with the skirts, once their depth is known)
+    mesh.packedNormals.resize(size * size);
+    pool.parallel_for(ssize(0), size, RowsPerTask, [&](ssize jb, ssize je)
+    {
+        for (auto j = jb; j < je; j++)
+            for (ssize i = 0; i < size; i++)
+            {
+                // The normalized cross product of (1, dx, 0) and (0, dy, -1), from the slopes of the function
+                auto normal = glm::normalize(glm::vec3(-samples.dxs(i + ioffset, j + joffset), 1, samples.dys(i + ioffset, j + joffset)));
+                mesh.packedNormals[j * size + i] = encodeNormal(normal);
+
+                // Keep a copy for the collisions
+                chunk.heights(i, j) = samples.heights(i + ioffset, j + joffset);
+                chunk.nys(i, j) = normal.y;
+            }
+    });
+
+    // Compute our own min and max height
+    auto [minIt, maxIt] = std::minmax_element(chunk.heights.begin(), chunk.heights.end());
+
+    // This will form the AABB for frustum culling
+    chunk.min = glm::vec3(xmin * resolution, *minIt, -(ymin + cells) * resolution);
+    chunk.max = glm::vec3((xmin + cells) * resolution, *maxIt, -ymin * resolution);
+
+    buildTrees(chunk, resolution, chunkSeed(seed, ci, cj));
+    finishChunk(chunk);
+
+    return chunk;
 }
 
-void Terrain::buildTerrain(ssize xmin, ssize ymin, ssize xmax, ssize ymax, int seed, bool wi, bool wj)
+// The vertices of a chunk are the grid, row by row, followed by the four skirts; the elements are all the
+// levels of detail one after the other
+std::vector<Terrain::LodRange> Terrain::buildTopology(ssize size, std::vector<std::uint16_t>& indices)
 {
-    // Some guarantees
-    if (xmin > xmax) std::swap(xmin, xmax);
-    if (ymin > ymax) std::swap(ymin, ymax);
-    if (xmin == xmax || ymin == ymax) return;
+    ssize cells = size - 1, skirtBase = size * size;
+    auto gridIndex = [&](ssize i, ssize j) { return std::uint16_t(j * size + i); };
+    if (skirtBase + 4 * size > 65536)
+        throw std::invalid_argument("Chunks too big for 16-bit indices");
+
+    std::vector<LodRange> lods;
+    indices.reserve(6 * cells * cells * 4 / 3 + 24 * cells * LodLevels);
+    for (ssize level = 0; level < LodLevels; level++)
+    {
+        ssize step = ssize(1) << level;
+        LodRange range = { indices.size(), 0 };
 
-    auto width = xmax - xmin + 1;
-    auto height = ymax - ymin + 1;
+        for (ssize j = step; j < size; j += step)
+            for (ssize i = step; i < size; i += step)
+            {
+                // Push the two triangles
+                indices.push_back(gridIndex(i - step, j - step));
+                indices.push_back(gridIndex(i, j - step));
+                indices.push_back(gridIndex(i, j));
+                indices.push_back(gridIndex(i - step, j - step));
+                indices.push_back(gridIndex(i, j));
+                indices.push_back(gridIndex(i - step, j));
+            }
 
-    // Threaded compute of our own min height
-    float localMinHeight = std::numeric_limits<float>::infinity();
-    float localMaxHeight = -std::numeric_limits<float>::infinity();
+        appendSkirts(size, step, indices);
+        range.count = indices.size() - range.first;
+        lods.push_back(range);
+    }
 
-    // In this phase, I'll only have a single mesh
-    gl::MeshBuilder mesh;
+    return lods;
+}
 
-    // First, we're going to build the vertices
-    mesh.positions.resize(width * height);
-    for (auto j = ymin; j <= ymax; j++)
-        for (auto i = xmin; i <= xmax; i++)
-        {
-            auto idx = (j - ymin) * width + (i - xmin);
+// The skirt quads of a level of detail, wound so they face outwards
+void Terrain::appendSkirts(ssize size, ssize step, std::vector<std::uint16_t>& indices)
+{
+    ssize cells = size - 1, skirtBase = size * size;
+    auto gridIndex = [&](ssize i, ssize j) { return std::uint16_t(j * size + i); };
+    auto quad = [&](std::uint16_t a, std::uint16_t b, std::uint16_t sa, std::uint16_t sb)
+    {
+        indices.insert(indices.end(), { a, sa, b, b, sa, sb });
+    };
 
-            float x = i * resolution;
-            float y = j * resolution;
-            float height = terrainFunction(x, y);
+    for (ssize k = step; k < size; k += step)
+    {
+        std::uint16_t k0 = k - step, k1 = k;
+        quad(gridIndex(k0, 0), gridIndex(k1, 0), skirtBase + k0, skirtBase + k1);
+        quad(gridIndex(k1, cells), gridIndex(k0, cells), skirtBase + size + k1, skirtBase + size + k0);
+        quad(gridIndex(0, k1), gridIndex(0, k0), skirtBase + 2 * size + k1, skirtBase + 2 * size + k0);
+        quad(gridIndex(cells, k0), gridIndex(cells, k1), skirtBase + 3 * size + k0, skirtBase + 3 * size + k1);
+    }
+}
 
-            // Push the position
-            mesh.positions[idx] = glm::vec3(x, height, -y);
+// Right-triangulated irregular network: each level of detail starts from the two halves of the chunk, and splits
+// a triangle at the middle of its hypotenuse while the height there is further than the error bound from the
+// hypotenuse (the error of a vertex includes the ones of the vertices below it, so the result is conforming).
+// The borders keep all the samples of their level, so the chunks meet their neighbours like the uniform grids do
+void Terrain::simplifyChunk(Chunk& chunk, float maxError)
+{
+    auto indexBytes = [&] { return chunk.lods.empty() ? 0 : (chunk.lods.back().first + chunk.lods.back().count) * sizeof(std::uint16_t); };
+    chunk.memoryUsage -= indexBytes();
+    chunk.simplifiedIndices.clear();
+    chunk.lods.clear();
+    if (maxError <= 0) return;
+
+    // A triangle is the ends of its hypotenuse (a, b), in order (the right angle is on its left when going from a to b)
+    using Triangle = glm::tvec4<std::uint8_t>;
+    static const auto hierarchies = []
+    {
+        // One per size of square, from the biggest chunks down to a single cell
+        std::vector<std::vector<Triangle>> hierarchies;
+        for (ssize cells = MaxChunkCells; cells >= 1; cells /= 2)
+        {
+            // The triangles of the binary tree, numbered in breadth-first order from 2 (the two halves of the square)
+            ssize count = 2 * cells * cells - 2;
+            auto& triangles = hierarchies.emplace_back(count);
+            for (ssize t = 0; t < count; t++)
+            {
+                auto id = t + 2;
+                ssize ax = 0, ay = 0, bx = cells, by = cells, cx = cells, cy = 0;
+                if (id % 2 == 0) std::swap(ax, bx), std::swap(ay, by), cx = 0, cy = cells;
 
-            localMinHeight = std::min(localMinHeight, height);
-            localMaxHeight = std::max(localMaxHeight, height);
+                for (id >>= 1; id > 1; id >>= 1)
+                {
+                    ssize mx = (ax + bx) / 2, my = (ay + by) / 2;
+                    if (id % 2) bx = ax, by = ay, ax = cx, ay = cy;
+                    else ax = bx, ay = by, bx = cx, by = cy;
+                    cx = mx, cy = my;
+                }
 
-            // Write to the grid - no data races here, each rectangle only writes its own part
-            if ((wi || i < xmax) && (wj || j < ymax)) 
-                heights(xofs + i, yofs + j) = height;
+                triangles[t] = Triangle(ax, ay, bx, by);
+            }
         }
 
-    // The normals
-    mesh.normals.resize(width * height);
-    for (auto j = ymin; j <= ymax; j++)
-        for (auto i = xmin; i <= xmax; i++)
+        return hierarchies;
+    }();
+
+    const auto& heights = chunk.heights;
+    ssize size = heights.width();
+    std::vector<float> errors;
+    std::vector<std::array<ssize, 6>> stack;
+    for (ssize level = 0; level < LodLevels; level++)
+    {
+        ssize step = ssize(1) << level, cells = (size - 1) / step, samples = cells + 1;
+        std::size_t table = 0;
+        while (ssize(MaxChunkCells >> table) > cells) table++;
+        const auto& triangles = hierarchies[table];
+        auto height = [&](ssize x, ssize y) { return heights(x * step, y * step); };
+
+        // The errors go from the smallest triangles up to the biggest ones; the middles of the border edges have
+        // an infinite error, so they are always there
+        errors.assign(samples * samples, 0.0f);
+        ssize parents = triangles.size() - cells * cells;
+        for (ssize t = triangles.size() - 1; t >= 0; t--)
         {
-            auto idx = (j - ymin) * width + (i - xmin);
+            ssize ax = triangles[t].x, ay = triangles[t].y, bx = triangles[t].z, by = triangles[t].w;
+            ssize mx = (ax + bx) / 2, my = (ay + by) / 2;
+            ssize cx = mx + my - ay, cy = my + ax - mx;
 
-            // Do the grad calculation
-            glm::vec3 gx, gy;
+            auto& error = errors[my * samples + mx];
+            if (mx == 0 || my == 0 || mx == cells || my == cells) error = std::numeric_limits<float>::infinity();
+            else error = std::max(error, std::abs(0.5f * (height(ax, ay) + height(bx, by)) - height(mx, my)));
 
-            // Sample outside of the map to have perfectly seamless normals
-            if (i == xmin)
-            {
-                float x = (i - 1) * resolution;
-                float y = j * resolution;
-                float height = terrainFunction(x, y);
-                gx = mesh.positions[idx + 1] - glm::vec3(x, height, -y);
-            }
-            else if (i == xmax)
-            {
-                float x = (i + 1) * resolution;
-                float y = j * resolution;
-                float height = terrainFunction(x, y);
-                gx = glm::vec3(x, height, -y) - mesh.positions[idx - 1];
-            }
-            else gx = mesh.positions[idx + 1] - mesh.positions[idx - 1];
+            if (t < parents)
+                error = std::max({ error, errors[(ay + cy) / 2 * samples + (ax + cx) / 2],
+                    errors[(by + cy) / 2 * samples + (bx + cx) / 2] });
+        }
 
-            if (j == ymin)
-            {
-                float x = i * resolution;
-                float y = (j - 1) * resolution;
-                float height = terrainFunction(x, y);
-                gy = mesh.positions[idx + width] - glm::vec3(x, height, -y);
-            }
-            else if (j == ymax)
+        // Then the triangles are split from the top while they are off by more than the error of the level
+        LodRange range = { chunk.simplifiedIndices.size(), 0 };
+        float levelError = maxError * step;
+        stack.push_back({ 0, 0, cells, cells, cells, 0 });
+        stack.push_back({ cells, cells, 0, 0, 0, cells });
+        while (!stack.empty())
+        {
+            auto [ax, ay, bx, by, cx, cy] = stack.back();
+            stack.pop_back();
+
+            ssize mx = (ax + bx) / 2, my = (ay + by) / 2;
+            if (std::abs(ax - cx) + std::abs(ay - cy) > 1 && errors[my * samples + mx] > levelError)
             {
-                float x = i * resolution;
-                float y = (j + 1) * resolution;
-                float height = terrainFunction(x, y);
-                gy = glm::vec3(x, height, -y) - mesh.positions[idx - width];
+                stack.push_back({ bx, by, cx, cy, mx, my });
+                stack.push_back({ cx, cy, ax, ay, mx, my });
             }
-            else gy = mesh.positions[idx + width] - mesh.positions[idx - width];
+            else for (auto [x, y] : { std::pair(ax, ay), std::pair(cx, cy), std::pair(bx, by) })
+                chunk.simplifiedIndices.push_back(std::uint16_t(y * step * size + x * step));
+        }
+
+        appendSkirts(size, step, chunk.simplifiedIndices);
+        range.count = chunk.simplifiedIndices.size() - range.first;
+        chunk.lods.push_back(range);
+    }
 
-            mesh.normals[idx] = glm::normalize(glm::cross(gx, gy));
+    chunk.memoryUsage += indexBytes();
+}
 
-            // Write to the grid - no data races here, each rectangle only writes its own part
-            if ((wi || i < xmax) && (wj || j < ymax)) 
-                nys(xofs + i, yofs + j) = mesh.normals[idx].y;
+// The borders of a coarser level are straight lines between its samples, so the gap it can leave
+// against a finer neighbour is at most the interpolation error along the borders
+static float computeSkirtDepth(const util::grid<float>& heights)
+{
+    using ssize = std::make_signed_t<std::size_t>;
+    ssize cells = heights.width() - 1;
+
+    float skirtDepth = 0;
+    for (ssize level = 1; level < LodLevels; level++)
+    {
+        ssize step = ssize(1) << level;
+        for (ssize k = 0; k < cells; k++)
+        {
+            ssize k0 = k / step * step, k1 = k0 + step;
+            float t = float(k - k0) / step;
+            auto error = [&](float a, float b, float h) { return std::abs(a + t * (b - a) - h); };
+
+            skirtDepth = std::max({ skirtDepth,
+                error(heights(k0, 0), heights(k1, 0), heights(k, 0)),
+                error(heights(k0, cells), heights(k1, cells), heights(k, cells)),
+                error(heights(0, k0), heights(0, k1), heights(0, k)),
+                error(heights(cells, k0), heights(cells, k1), heights(cells, k)) });
         }
+    }
+
+    return skirtDepth;
+}
+
+// A height as a 16-bit fraction of the range of its chunk (base, extent)
+static std::uint16_t quantizeHeight(const glm::vec2& range, float h)
+{
+    return std::uint16_t(std::lround(glm::clamp((h - range.x) / range.y, 0.0f, 1.0f) * 65535));
+}
 
-    // Now for the topology
-    mesh.indices.reserve(6 * (width - 1) * (height - 1));
-    for (ssize j = 1; j < height; j++)
-        for (ssize i = 1; i < width; i++)
+void Terrain::finishChunk(Chunk& chunk)
+{
+    const auto& heights = chunk.heights;
+    ssize size = heights.width(), cells = size - 1;
+    auto& mesh = chunk.builder;
+
+    // The heights are quantized to 16 bits over the range of the chunk, skirts included
+    chunk.skirtDepth = computeSkirtDepth(heights);
+    auto [minIt, maxIt] = std::minmax_element(heights.begin(), heights.end());
+    float base = *minIt - chunk.skirtDepth - SkirtMargin;
+    chunk.heightRange = glm::vec2(base, std::max(*maxIt - base, std::numeric_limits<float>::min()));
+
+    // The shader rebuilds X and Z from the index of the vertex, so this layout has to match terrain.vert
+    auto skirtBase = size * size;
+    auto gridIndex = [&](ssize i, ssize j) { return j * size + i; };
+    mesh.packedPositions.resize(skirtBase + 4 * size);
+    for (ssize j = 0; j < size; j++)
+        for (ssize i = 0; i < size; i++)
+            mesh.packedPositions[gridIndex(i, j)] = quantizeHeight(chunk.heightRange, heights(i, j));
+
+    // The skirts: a copy of each border, moved down (bottom, top, left and right)
+    mesh.packedNormals.resize(skirtBase + 4 * size);
+    for (ssize k = 0; k < size; k++)
+        for (auto [edge, i, j] : { std::tuple(0, k, ssize(0)), std::tuple(1, k, cells),
+            std::tuple(2, ssize(0), k), std::tuple(3, cells, k) })
         {
-            // Push the two triangles
-            mesh.indices.push_back((j - 1) * width + (i - 1));
-            mesh.indices.push_back((j - 1) * width + i);
-            mesh.indices.push_back(j * width + i);
-            mesh.indices.push_back((j - 1) * width + (i - 1));
-            mesh.indices.push_back(j * width + i);
-            mesh.indices.push_back(j * width + (i - 1));
+            mesh.packedPositions[skirtBase + edge * size + k] =
+                quantizeHeight(chunk.heightRange, heights(i, j) - chunk.skirtDepth - SkirtMargin);
+            mesh.packedNormals[skirtBase + edge * size + k] = mesh.packedNormals[gridIndex(i, j)];
         }
 
-    // Compute the min and max height per grid
-    ssize ci = (xofs + xmin) / MaxCellDivision, cj = (yofs + ymin) / MaxCellDivision;
-    minHeight(ci, cj) = localMinHeight;
-    maxHeight(ci, cj) = localMaxHeight;
+    // The min/max pyramid for the ray casts: level k holds squares of 2^k cells (level 0 would be the cells
+    // themselves, which are cheap enough to get from the heights), up to the whole chunk
+    chunk.heightPyramid.clear();
+    std::size_t pyramidSize = 0;
+    for (ssize nodes = cells / 2; nodes >= 1; nodes /= 2)
+    {
+        chunk.heightPyramid.emplace_back(nodes, nodes);
+        pyramidSize += nodes * nodes;
+    }
+    updateHeightPyramid(chunk, 0, 0, cells - 1, cells - 1);
+
+    chunk.memoryUsage = 2 * size * size * sizeof(float) + pyramidSize * sizeof(glm::vec2)
+        + mesh.packedPositions.size() * sizeof(std::uint16_t) + mesh.packedNormals.size() * sizeof(glm::i16vec2)
+        + chunk.treePositions.size() * (sizeof(glm::vec3) + 2 * sizeof(glm::mat4));
+    chunk.lastUsed = 0;
+}
 
+void Terrain::updateHeightPyramid(Chunk& chunk, ssize imin, ssize jmin, ssize imax, ssize jmax)
+{
+    const auto& heights = chunk.heights;
+    for (std::size_t level = 0; level < chunk.heightPyramid.size(); level++)
     {
-        std::lock_guard lock(terrainMutex);
-        temporaryBuilders.emplace_back(std::move(mesh));
+        // Node (i, j) of this level covers the cells [i, i + 1) * 2^(level + 1)
+        auto& nodes = chunk.heightPyramid[level];
+        auto shift = level + 1;
+        for (ssize j = jmin >> shift; j <= jmax >> shift; j++)
+            for (ssize i = imin >> shift; i <= imax >> shift; i++)
+            {
+                glm::vec2 range(std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity());
+                if (level == 0)
+                {
+                    for (ssize dj = 0; dj <= 2; dj++)
+                        for (ssize di = 0; di <= 2; di++)
+                        {
+                            auto h = heights(2 * i + di, 2 * j + dj);
+                            range = glm::vec2(std::min(range.x, h), std::max(range.y, h));
+                        }
+                }
+                else
+                {
+                    const auto& finer = chunk.heightPyramid[level - 1];
+                    for (auto child : { finer(2 * i, 2 * j), finer(2 * i + 1, 2 * j), finer(2 * i, 2 * j + 1), finer(2 * i + 1, 2 * j + 1) })
+                        range = glm::vec2(std::min(range.x, child.x), std::max(range.y, child.y));
+                }
 
-        // This will form the AABB for frustum culling
-        terrainMin.emplace_back(xmin * resolution, localMinHeight, -ymax * resolution);
-        terrainMax.emplace_back(xmax * resolution, localMaxHeight, -ymin * resolution);
+                nodes(i, j) = range;
+            }
     }
 }
 
+// Layout of the tile files: this header, then the heights, the normal Ys, the packed normals, and the trees
+// (the positions, then the trunk transforms, then the cone transforms)
+struct TileHeader
+{
+    char magic[4];
+    std::uint32_t size, numTrees, padding;
+    std::uint64_t key;
+    std::int64_t ci, cj;
+    glm::vec3 min, max;
+};
+
+constexpr char TileMagic[4] = { 'T', 'I', 'L', 'E' };
+constexpr std::uint32_t TileFormatVersion = 4;
+
+// FNV-1a of everything that changes the contents of the tiles
+static std::uint64_t tileCacheKey(int seed, float width, float height, float resolution,
+    std::make_signed_t<std::size_t> chunkCells)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&](const auto& value)
+    {
+        auto bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (std::size_t k = 0; k < sizeof(value); k++)
+            hash = (hash ^ bytes[k]) * 0x100000001b3ull;
+    };
+
+    mix(TileFormatVersion);
+    mix(TerrainFunction::Version);
+    mix(chunkCells);
+    mix(seed);
+    mix(width);
+    mix(height);
+    mix(resolution);
+    return hash;
+}
+
+void Terrain::openCache(const std::filesystem::path& root, int seed, float width, float height)
+{
+    if (root.empty()) return;
+
+    // Each set of parameters gets its own directory, so changing them never reads stale tiles
+    cacheKey = tileCacheKey(seed, width, height, resolution, chunkCells);
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)cacheKey);
+
+    // The cache is only an optimization, so if the directory can't be created just go without it
+    std::error_code error;
+    cacheDirectory = root / name;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if (error) cacheDirectory.clear();
+}
+
+std::filesystem::path Terrain::tilePath(const std::filesystem::path& directory, ssize ci, ssize cj)
+{
+    return directory / (std::to_string(ci) + "_" + std::to_string(cj) + ".tile");
+}
+
+bool Terrain::loadChunk(const std::filesystem::path& directory, std::uint64_t key, ssize cells, ssize ci, ssize cj,
+    Chunk& chunk)
+{
+    ssize size = cells + 1;
+    if (directory.empty()) return false;
+
+    util::mapped_file file(tilePath(directory, ci, cj));
+    if (file.size() < sizeof(TileHeader)) return false;
+
+    // Validate the tile before trusting anything in it
+    TileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, TileMagic, sizeof(TileMagic)) != 0 || header.key != key
+        || header.ci != ci || header.cj != cj || header.size != size)
+        return false;
+
+    std::size_t numTrees = header.numTrees;
+    auto expectedsize = sizeof(TileHeader) + size * size * (2 * sizeof(float) + sizeof(glm::i16vec2))
+        + numTrees * (sizeof(glm::vec3) + 2 * sizeof(glm::mat4));
+    if (file.size() != expectedsize) return false;
+
+    auto ptr = file.data() + sizeof(TileHeader);
+    auto read = [&](void* dest, std::size_t bytes) { std::memcpy(dest, ptr, bytes); ptr += bytes; };
+
+    chunk.ci = ci, chunk.cj = cj;
+    chunk.min = header.min, chunk.max = header.max;
+    chunk.heights.resize(size, size);
+    chunk.nys.resize(size, size);
+    read(chunk.heights.data(), size * size * sizeof(float));
+    read(chunk.nys.data(), size * size * sizeof(float));
+
+    auto& mesh = chunk.builder;
+    mesh.packedNormals.resize(size * size);
+    read(mesh.packedNormals.data(), size * size * sizeof(glm::i16vec2));
+
+    chunk.treePositions.resize(numTrees);
+    chunk.trunkTransforms.resize(numTrees);
+    chunk.coneTransforms.resize(numTrees);
+    read(chunk.treePositions.data(), numTrees * sizeof(glm::vec3));
+    read(chunk.trunkTransforms.data(), numTrees * sizeof(glm::mat4));
+    read(chunk.coneTransforms.data(), numTrees * sizeof(glm::mat4));
+
+    finishChunk(chunk);
+    return true;
+}
+
+void Terrain::saveChunk(const std::filesystem::path& directory, std::uint64_t key, const Chunk& chunk)
+{
+    if (directory.empty()) return;
+
+    TileHeader header{};
+    std::memcpy(header.magic, TileMagic, sizeof(TileMagic));
+    header.size = chunk.heights.width();
+    header.numTrees = chunk.treePositions.size();
+    header.key = key;
+    header.ci = chunk.ci, header.cj = chunk.cj;
+    header.min = chunk.min, header.max = chunk.max;
+
+    auto write = [](std::ofstream& out, const void* data, std::size_t bytes)
+        { out.write(static_cast<const char*>(data), bytes); };
+
+    // Write to a temporary file first, so a tile is either complete or not there at all
+    auto path = tilePath(directory, chunk.ci, chunk.cj);
+    auto tempPath = path;
+    tempPath += ".tmp";
+
+    {
+        std::ofstream out(tempPath, std::ios::binary);
+        write(out, &header, sizeof(header));
+        write(out, chunk.heights.data(), chunk.heights.width() * chunk.heights.height() * sizeof(float));
+        write(out, chunk.nys.data(), chunk.nys.width() * chunk.nys.height() * sizeof(float));
+        write(out, chunk.builder.packedNormals.data(), chunk.heights.width() * chunk.heights.height() * sizeof(glm::i16vec2));
+        write(out, chunk.treePositions.data(), chunk.treePositions.size() * sizeof(glm::vec3));
+        write(out, chunk.trunkTransforms.data(), chunk.trunkTransforms.size() * sizeof(glm::mat4));
+        write(out, chunk.coneTransforms.data(), chunk.coneTransforms.size() * sizeof(glm::mat4));
+        if (out) out.close();
+        if (!out) return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error) std::filesystem::remove(tempPath, error);
+}
+
 constexpr float TreeRadius = 3;
-constexpr float MinTrunkHeight = 6, MaxTrunkHeight = 15;
+constexpr float MinTrunkHeight = 6, MaxTrunkHeight = 15, ConeHeight = 8;
+
+// Samples thrown per tree before giving up (chunks mostly under water or on cliffs end up with fewer trees)
+constexpr std::size_t MaxTreeAttempts = 64;
 constexpr float MinConeSize = 2, MaxConeSize = 7;
 
-void Terrain::buildTrees(int seed)
-{
-    // Create the tree mesh
-    trunkMesh = mesh_utils::openCylinder(glm::vec3(0, 0, 0), glm::vec3(0, 1, 0), 1, colors::CocoaBrown, 32);
-    coneMesh = mesh_utils::closedCone(glm::vec3(0, 0, 0), glm::vec3(0, 8, 0), 1, colors::DarkGreen, 32);
-    trunkMesh.setName("Trunk Mesh");
-    coneMesh.setName("Cone Mesh");
+// Trees per cell
+constexpr float TreeDensity = 1.0f / 2048;
 
+void Terrain::buildTrees(Chunk& chunk, float resolution, std::uint64_t seed)
+{
     // Generate a random number of trees
-    std::mt19937 random(seed);
+    std::mt19937 random(std::uint32_t(seed ^ (seed >> 32)));
 
-    auto width = heights.width(), height = heights.height();
+    const auto& heights = chunk.heights;
+    const auto& nys = chunk.nys;
+    ssize size = heights.width();
 
-    // Try to fill 0.05% of the terrain with trees
+    // Try to fill 0.05% of the terrain with trees; the trees keep their distance from the border, so
+    // they can't get too close to the trees of the neighbouring chunks
     ssize radius = std::ceil(TreeRadius / resolution);
-    std::size_t numTrees = width * height / 2000;
-    std::vector<glm::tvec2<ssize>> indices;
-    indices.reserve((width - 2 * radius) * (height - 2 * radius));
-    for (std::size_t j = radius; j < height - radius; j++)
-        for (std::size_t i = radius; i < height - radius; i++)
-            indices.emplace_back(i, j);
-    std::shuffle(indices.begin(), indices.end(), random);
-
+    // (the fraction of a tree left on small chunks is a chance of one more)
+    float expectedTrees = (size - 1) * (size - 1) * TreeDensity;
+    std::size_t numTrees = expectedTrees;
+    if (numTrees < expectedTrees && std::uniform_real_distribution(0.0f, 1.0f)(random) < expectedTrees - numTrees) numTrees++;
+    if (size - 2 * radius <= 0) return;
+
+    // Dart throwing: random samples, rejected when they are closer than radius (in the same diamond
+    // metric as the rest of the grid code) to an accepted one; the accepted trees are hashed into buckets
+    // small enough that two of them can never share one, so only the buckets around a sample are checked
+    ssize bucketSize = radius / 2 + 1, reach = radius / bucketSize + 1;
+    ssize numBuckets = (size + bucketSize - 1) / bucketSize;
+    util::grid<int> buckets(numBuckets, numBuckets, -1);
+    std::vector<glm::tvec2<ssize>> accepted;
+
+    std::uniform_int_distribution<ssize> coordGen(radius, size - radius - 1);
     std::uniform_real_distribution heightGen(MinTrunkHeight, MaxTrunkHeight);
     std::uniform_real_distribution sizeGen(MinConeSize, MaxConeSize);
-    treeHeights.resize(width, height, 0);
 
-    trunkTransforms.reserve(numTrees);
-    coneTransforms.reserve(numTrees);
-    for (const auto& vec : indices)
+    chunk.trunkTransforms.reserve(numTrees);
+    chunk.coneTransforms.reserve(numTrees);
+    for (std::size_t attempt = 0; attempt < MaxTreeAttempts * numTrees && accepted.size() < numTrees; attempt++)
     {
-        auto i = vec.x, j = vec.y;
+        auto i = coordGen(random), j = coordGen(random);
         float h = std::min({ heights(i, j), heights(i + 1, j), heights(i - 1, j), heights(i, j - 1), heights(i, j + 1) });
 
         // Don't generate trees in water
@@ -263,61 +754,198 @@ void Terrain::buildTrees(int seed)
         float ny = std::min({ nys(i, j), nys(i + 1, j), nys(i - 1, j), nys(i, j - 1), nys(i, j + 1) });
         if (ny < 0.75) continue;
 
-        bool skipTree = false;
-
         // Don't place trees too close to each other
-        for (ssize ci = -radius; ci <= radius; ci++)
-        {
-            ssize mj = radius - std::abs(ci);
-            for (ssize cj = -mj; cj <= mj; cj++)
-                if (treeHeights(i + ci, j + cj) > 0)
-                {
-                    skipTree = true;
-                    break;
-                }
-
-            if (skipTree) break;
-        }
+        ssize bi = i / bucketSize, bj = j / bucketSize;
+        bool skipTree = false;
+        for (ssize nj = std::max<ssize>(bj - reach, 0); nj <= std::min(bj + reach, numBuckets - 1) && !skipTree; nj++)
+            for (ssize ni = std::max<ssize>(bi - reach, 0); ni <= std::min(bi + reach, numBuckets - 1) && !skipTree; ni++)
+            {
+                auto other = buckets(ni, nj);
+                skipTree = other >= 0 && std::abs(accepted[other].x - i) + std::abs(accepted[other].y - j) <= radius;
+            }
 
         if (skipTree) continue;
+        buckets(bi, bj) = int(accepted.size());
+        accepted.emplace_back(i, j);
 
         float trunkHeight = heightGen(random);
         float coneSize = sizeGen(random);
-        treeHeights(i, j) = trunkHeight + 8;
 
-        auto ci = i / MaxCellDivision, cj = j / MaxCellDivision;
-        minHeight(ci, cj) = std::min(minHeight(ci, cj), h);
-        maxHeight(ci, cj) = std::max(maxHeight(ci, cj), h + trunkHeight + 8);
+        chunk.min.y = std::min(chunk.min.y, h);
+        chunk.max.y = std::max(chunk.max.y, h + trunkHeight + ConeHeight);
 
-        auto trunkPos = glm::vec3((i - xofs) * resolution, h, -(j - yofs) * resolution);
-        treePositions.emplace_back(trunkPos);
+        auto gi = chunk.ci * (size - 1) + i, gj = chunk.cj * (size - 1) + j;
+        auto trunkPos = glm::vec3(gi * resolution, h, -gj * resolution);
+        chunk.treePositions.emplace_back(trunkPos);
 
         auto trunkScale = glm::vec3(1, trunkHeight, 1);
-        trunkTransforms.emplace_back(glm::scale(trunkScale));
+        chunk.trunkTransforms.emplace_back(glm::scale(trunkScale));
 
         auto conePos = glm::vec3(0, trunkHeight, 0);
         auto coneScale = glm::vec3(coneSize, 1, coneSize);
-        coneTransforms.emplace_back(glm::translate(conePos) * glm::scale(coneScale));
+        chunk.coneTransforms.emplace_back(glm::translate(conePos) * glm::scale(coneScale));
+    }
+}
+
+void Terrain::insertChunk(Chunk&& chunk)
+{
+    // The GL objects can only be created here
+    chunk.mesh = gl::Mesh(chunk.builder, chunkElements);
+    chunk.mesh.setName("Terrain Mesh " + std::to_string(chunk.ci) + "," + std::to_string(chunk.cj));
+    chunk.builder = {};
+    if (!chunk.lods.empty()) uploadElements(chunk);
+    chunk.lastUsed = frame;
+
+    globalMinHeight = std::min(globalMinHeight, chunk.min.y);
+    globalMaxHeight = std::max(globalMaxHeight, chunk.max.y);
+    memoryUsage += chunk.memoryUsage;
+
+    if (chunks.empty()) residentMinI = residentMaxI = chunk.ci, residentMinJ = residentMaxJ = chunk.cj;
+    residentMinI = std::min(residentMinI, chunk.ci), residentMaxI = std::max(residentMaxI, chunk.ci);
+    residentMinJ = std::min(residentMinJ, chunk.cj), residentMaxJ = std::max(residentMaxJ, chunk.cj);
+
+    auto key = chunkKey(chunk.ci, chunk.cj);
+    chunks.insert_or_assign(key, std::move(chunk));
+    treesChanged = true;
+}
 
-        if (trunkTransforms.size() == numTrees) break;
+void Terrain::updateResidentBounds()
+{
+    residentMinI = residentMinJ = std::numeric_limits<ssize>::max();
+    residentMaxI = residentMaxJ = std::numeric_limits<ssize>::min();
+    for (const auto& [key, chunk] : chunks)
+    {
+        residentMinI = std::min(residentMinI, chunk.ci), residentMaxI = std::max(residentMaxI, chunk.ci);
+        residentMinJ = std::min(residentMinJ, chunk.cj), residentMaxJ = std::max(residentMaxJ, chunk.cj);
     }
+}
 
-    // Generate the shearing parameters
-    constexpr float MaxShearingRadius = 0.25;
-    std::uniform_real_distribution radiusGen(0.0f, MaxShearingRadius);
-    shearingEllipse = glm::vec2(radiusGen(random), radiusGen(random));
-    shearingRotation = std::uniform_real_distribution(0.0f, 2 * Pi)(random);
+// Point the mesh of the chunk at its own triangulation, or at the shared one if it has none
+void Terrain::uploadElements(Chunk& chunk)
+{
+    if (chunk.lods.empty())
+    {
+        chunk.mesh.setElements(chunkElements);
+        chunk.elements = {};
+        return;
+    }
+
+    gl::ElementBuffer elements(chunk.simplifiedIndices);
+    elements.setName("Terrain Elements " + std::to_string(chunk.ci) + "," + std::to_string(chunk.cj));
+    chunk.mesh.setElements(elements);
+    chunk.elements = std::move(elements);
+    chunk.simplifiedIndices = {};
+}
+
+void Terrain::scheduleChunk(ssize ci, ssize cj)
+{
+    auto state = streaming.get();
+    state->inFlight.insert(chunkKey(ci, cj));
+
+    // The task only holds what won't move along with the terrain
+    state->pool.submit(state->tasks, [state, function = terrainFunction, resolution = resolution, seed = seed,
+        directory = cacheDirectory, key = cacheKey, maxError = simplificationError, cells = chunkCells, ci, cj]
+    {
+        Chunk chunk;
+        if (!loadChunk(directory, key, cells, ci, cj, chunk))
+        {
+            // Each chunk samples its own region
+            auto samples = sampleRegion(state->pool, *function, resolution, ci * cells, cj * cells, cells + 1, cells + 1);
+            chunk = buildChunk(state->pool, samples, resolution, seed, cells, ci, cj);
+            saveChunk(directory, key, chunk);
+        }
+
+        simplifyChunk(chunk, maxError);
+        std::lock_guard lock(state->readyMutex);
+        state->ready.push_back(std::move(chunk));
+    });
+}
+
+void Terrain::evictChunks(std::size_t reserve)
+{
+    auto budget = streaming->settings.memoryBudget;
+    if (memoryUsage + reserve <= budget) return;
+
+    // Only the chunks that weren't requested this frame can go, the least recently used first
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> candidates;
+    for (const auto& [key, chunk] : chunks)
+        if (chunk.lastUsed < frame) candidates.emplace_back(chunk.lastUsed, key);
+    std::sort(candidates.begin(), candidates.end());
+
+    for (const auto& candidate : candidates)
+    {
+        if (memoryUsage + reserve <= budget) break;
+
+        auto it = chunks.find(candidate.second);
+        memoryUsage -= it->second.memoryUsage;
+        chunks.erase(it);
+        treesChanged = true;
+    }
+
+    updateResidentBounds();
+}
+
+void Terrain::stream(const glm::vec3& position, const glm::mat4& viewProjection)
+{
+    if (!streaming) return;
+    auto& state = *streaming;
+    frame++;
+
+    // Upload some of the finished chunks
+    std::vector<Chunk> finished;
+    {
+        std::lock_guard lock(state.readyMutex);
+        auto count = std::min(state.ready.size(), state.settings.maxUploadsPerFrame);
+        std::move(state.ready.begin(), state.ready.begin() + count, std::back_inserter(finished));
+        state.ready.erase(state.ready.begin(), state.ready.begin() + count);
+    }
+
+    for (auto& chunk : finished)
+    {
+        state.inFlight.erase(chunkKey(chunk.ci, chunk.cj));
+        insertChunk(std::move(chunk));
+    }
+
+    // Mark the chunks in view as used, and collect the missing ones: first the ones in the frustum, then the nearest
+    auto frustum = util::frustumPlanes(viewProjection);
+    float chunkSize = chunkCells * resolution;
+    std::vector<std::tuple<bool, float, ssize, ssize>> missing;
+    forEachChunkAround(position, resolution, chunkCells, state.settings.viewDistance, [&](ssize ci, ssize cj, float distance)
+    {
+        auto key = chunkKey(ci, cj);
+        if (auto it = chunks.find(key); it != chunks.end()) it->second.lastUsed = frame;
+        else if (!state.inFlight.count(key))
+        {
+            // We don't know the heights yet, so assume the whole range seen so far
+            auto min = glm::vec3(ci * chunkSize, globalMinHeight, -(cj + 1) * chunkSize);
+            auto max = glm::vec3((ci + 1) * chunkSize, globalMaxHeight, -cj * chunkSize);
+            missing.emplace_back(!frustum.checkIntersectionAABB(min, max), distance, ci, cj);
+        }
+    });
+
+    std::sort(missing.begin(), missing.end());
+
+    // Make room for what will be requested, then request as much as the limits allow
+    auto maxInFlight = state.settings.maxChunksInFlight ? state.settings.maxChunksInFlight : state.pool.concurrency();
+    auto toRequest = std::min(missing.size(), maxInFlight - std::min(maxInFlight, state.inFlight.size()));
+    auto chunkMemory = chunks.empty() ? 0 : memoryUsage / chunks.size();
+    evictChunks((state.inFlight.size() + toRequest) * chunkMemory);
+
+    for (std::size_t k = 0; k < toRequest; k++)
+    {
+        if (memoryUsage + (state.inFlight.size() + 1) * chunkMemory > state.settings.memoryBudget) break;
+        scheduleChunk(std::get<2>(missing[k]), std::get<3>(missing[k]));
+    }
 }
 
 constexpr GLsizei TextureSize = 64;
 void Terrain::generateDirtTexture(int seed)
 {
-    std::mt19937 random(seed);
-    std::uniform_real_distribution floatGen(0.4f, 1.0f);
+    util::counter_rng random(seed);
 
     // Create the size texture
     std::vector<float> image(TextureSize * TextureSize * TextureSize);
-    std::generate(image.begin(), image.end(), [&] { return floatGen(random); });
+    util::bake_texels(util::thread_pool::global(), image.data(), image.size(), [&](std::size_t k) { return random.uniform(k, 0.4f, 1.0f); });
 
     // Configure the texture
     dirtTexture.assign(0, gl::InternalFormat::R16, TextureSize, TextureSize, TextureSize, gl::Format::Red, image.data());
@@ -334,30 +962,126 @@ void Terrain::update(double delta)
 {
     time += delta;
 
-    // Generate the final transform
-    std::vector<glm::mat4> trunkFinalTransforms(treePositions.size());
-    std::vector<glm::mat4> coneFinalTransforms(treePositions.size());
-
+    // The sway is a shear of the trees around their base, applied by the shader
     auto angle = Pi * time / 2;
     auto shear = glm::vec2(std::cos(angle), std::sin(angle)) * shearingEllipse;
     auto cr = std::cos(shearingRotation), sr = std::sin(shearingRotation);
-    auto shearing = glm::mat4(1.0);
-    shearing[1][0] = cr * shear.x + sr * shear.y;
-    shearing[1][2] = -sr * shear.x + cr * shear.y;
+    sway = glm::vec2(cr * shear.x + sr * shear.y, -sr * shear.x + cr * shear.y);
+
+    // The instances only change with the resident chunks
+    if (!treesChanged) return;
+    treesChanged = false;
 
-    util::range rng(std::size_t(0), treePositions.size());
-    std::for_each(POLICY rng.begin(), rng.end(), [&](std::size_t i)
+    std::size_t numTrees = 0;
+    for (const auto& [key, chunk] : chunks) numTrees += chunk.treePositions.size();
+
+    trunkFinalTransforms.resize(numTrees);
+    coneFinalTransforms.resize(numTrees);
+    treeBounds.resize(numTrees);
+    treeRuns.clear();
+
+    std::size_t first = 0;
+    for (auto& [key, chunk] : chunks)
+    {
+        util::range rng(std::size_t(0), chunk.treePositions.size());
+        std::for_each(POLICY rng.begin(), rng.end(), [&, first](std::size_t i) { setTreeInstance(chunk, i, first + i); });
+
+        if (!chunk.treePositions.empty())
         {
-            // Compute the final transforms
-            trunkFinalTransforms[i] = glm::translate(treePositions[i]) * shearing * trunkTransforms[i];
-            coneFinalTransforms[i] = glm::translate(treePositions[i]) * shearing * coneTransforms[i];
-        });
+            chunk.treeRun = treeRuns.size();
+            treeRuns.push_back({ first, chunk.treePositions.size(), treeBounds[first] });
+            updateTreeRunBounds(treeRuns.back());
+        }
+
+        first += chunk.treePositions.size();
+    }
 
     // Set the instances
     trunkInstances.setInstances(trunkFinalTransforms);
     coneInstances.setInstances(coneFinalTransforms);
 }
 
+void Terrain::setTreeInstance(const Chunk& chunk, std::size_t i, std::size_t index)
+{
+    // The last row of the matrices (always 0, 0, 0, 1 otherwise) holds the height of the local origin above the base
+    auto instance = [](const glm::vec3& position, const glm::mat4& transform)
+    {
+        auto matrix = glm::translate(position) * transform;
+        matrix[0][3] = transform[3][1];
+        return matrix;
+    };
+
+    const auto& position = chunk.treePositions[i];
+    trunkFinalTransforms[index] = instance(position, chunk.trunkTransforms[i]);
+    coneFinalTransforms[index] = instance(position, chunk.coneTransforms[i]);
+
+    // The bounds hold the trunk and the cone, which is ConeHeight tall and as wide as its scale
+    float radius = std::max(1.0f, chunk.coneTransforms[i][0][0]);
+    float height = chunk.trunkTransforms[i][1][1] + ConeHeight;
+    treeBounds[index] = { position - glm::vec3(radius, 0, radius), position + glm::vec3(radius, height, radius) };
+}
+
+void Terrain::updateTreeRunBounds(TreeRun& run)
+{
+    run.bounds = treeBounds[run.first];
+    for (std::size_t i = run.first; i < run.first + run.count; i++)
+    {
+        run.bounds.min = glm::min(run.bounds.min, treeBounds[i].min);
+        run.bounds.max = glm::max(run.bounds.max, treeBounds[i].max);
+    }
+}
+
+void Terrain::setLodCenter(const glm::vec3& position)
+{
+    lodCenter = position;
+}
+
+void Terrain::setLodDistances(std::vector<float> distances)
+{
+    std::sort(distances.begin(), distances.end());
+    lodDistances = std::move(distances);
+}
+
+void Terrain::setSimplification(float maxError, util::thread_pool& pool)
+{
+    simplificationError = maxError;
+
+    std::vector<Chunk*> resident;
+    resident.reserve(chunks.size());
+    for (auto& [key, chunk] : chunks)
+    {
+        resident.push_back(&chunk);
+        memoryUsage -= chunk.memoryUsage;
+    }
+
+    pool.parallel_for(std::size_t(0), resident.size(), std::size_t(1), [&](std::size_t begin, std::size_t end)
+    {
+        for (auto k = begin; k < end; k++) simplifyChunk(*resident[k], maxError);
+    });
+
+    for (auto chunk : resident)
+    {
+        uploadElements(*chunk);
+        memoryUsage += chunk->memoryUsage;
+    }
+}
+
+std::vector<TerrainChunkStats> Terrain::getChunkStats() const
+{
+    // The skirts are two triangles per border edge
+    auto skirtTriangles = 8 * chunkCells;
+
+    std::vector<TerrainChunkStats> stats;
+    stats.reserve(chunks.size());
+    for (const auto& [key, chunk] : chunks)
+    {
+        const auto& range = chunk.lods.empty() ? lods[0] : chunk.lods[0];
+        stats.push_back({ chunk.ci, chunk.cj, range.count / 3 - skirtTriangles, lods[0].count / 3 - skirtTriangles });
+    }
+
+    return stats;
+}
+
 void Terrain::setColors(const glm::u8vec4& grassColor, const glm::u8vec4& sandColor, const glm::u8vec4& mountainColor)
 {
     terrainProgram->setUniform("GrassColor", glm::vec3(grassColor) / 255.0f);
@@ -367,68 +1091,757 @@ void Terrain::setColors(const glm::u8vec4& grassColor, const glm::u8vec4& sandCo
 
 void Terrain::setClipPlane(const glm::vec4& plane)
 {
+    clipPlane = plane;
     terrainProgram->setUniform("ClipPlane", plane);
     treesProgram->setUniform("ClipPlane", plane);
 }
 
-void Terrain::draw(const glm::mat4& projection, const glm::mat4& view, const Lighting& lighting)
+void Terrain::draw(gl::RenderQueue& queue, const glm::mat4& projection, const glm::mat4& view)
 {
-    for (auto prog : { terrainProgram.get(), treesProgram.get() })
+    terrainProgram->setUniform("NoiseTexture", 0);
+    terrainProgram->setUniform("UnitsPerPeriod", 32.0f);
+    terrainProgram->setUniform("CellSize", resolution);
+    terrainProgram->setUniform("ChunkSamples", int(chunkCells + 1));
+
+    auto viewProjection = projection * view;
+    auto frustum = util::frustumPlanes(viewProjection);
+    bool occluded = occlusionEnabled && viewProjection == occlusionViewProjection;
+    auto selected = selectChunks(viewProjection);
+
+    cullStats = {};
+    cullStats.chunksOutside = chunks.size() - selected.size();
+    trianglesDrawn = fullTriangles = 0;
+    for (const auto& [distance, chunk, level] : selected)
     {
-        lighting.setLightParams(*prog, view);
-        prog->setUniform("Projection", projection);
-        prog->setUniform("View", view);
+        if (occluded && !occlusion.visible(chunk->min, chunk->max))
+        {
+            cullStats.chunksOccluded++;
+            continue;
+        }
+
+        cullStats.chunksDrawn++;
+        const auto& range = chunk->lods.empty() ? lods[level] : chunk->lods[level];
+        trianglesDrawn += range.count / 3;
+        fullTriangles += lods[0].count / 3;
+
+        // Front to back, by the nearest corner of the chunk
+        float nearest = -util::planeDistanceAABB(-frustum.near, chunk->min, chunk->max);
+        queue.submit(OpaqueLayer, *terrainProgram, nearest, [this, chunk = chunk, range = range]
+        {
+            chunkOriginUniform.set(glm::vec2(chunk->ci, -chunk->cj) * (chunkCells * resolution));
+            heightRangeUniform.set(chunk->heightRange);
+            chunk->mesh.draw(glm::mat4(1.0), range.first, range.count);
+        }, { gl::TextureBinding::of(dirtTexture, 0) });
     }
 
-    auto frustum = util::frustumPlanes(projection * view);
+    treesProgram->setUniform("Sway", sway);
+    drawTrees(queue, viewProjection, occluded);
+}
 
-    terrainProgram->use();
+// The most culled trees drawn anyway to avoid splitting a draw call
+constexpr std::size_t MaxTreeGap = 8;
 
-    dirtTexture.bindTo(0);
-    terrainProgram->setUniform("NoiseTexture", 0);
-    terrainProgram->setUniform("UnitsPerPeriod", 32.0f);
+void Terrain::drawTrees(gl::RenderQueue& queue, const glm::mat4& viewProjection, bool occluded)
+{
+    auto frustum = util::frustumPlanes(viewProjection);
+
+    // The sway moves the top of a tree by its height times the sway, along x and z
+    auto swept = [&](TreeBounds bounds)
+    {
+        auto shift = glm::abs(glm::vec3(sway.x, 0, sway.y)) * (bounds.max.y - bounds.min.y);
+        return TreeBounds{ bounds.min - shift, bounds.max + shift };
+    };
+    auto inView = [&](const TreeBounds& bounds)
+    {
+        return frustum.checkIntersectionAABB(bounds.min, bounds.max) && util::planeDistanceAABB(clipPlane, bounds.min, bounds.max) > 0;
+    };
+
+    // The trees are in runs of the same chunk, so the ones left are mostly contiguous ranges; a few culled trees
+    // between two ranges cost less to draw than another draw call, so these ranges are merged
+    visibleTrees.clear();
+    auto keep = [&](std::size_t i, const TreeBounds& bounds)
+    {
+        if (!visibleTrees.empty() && visibleTrees.back().first + visibleTrees.back().count + MaxTreeGap >= i)
+        {
+            auto& range = visibleTrees.back();
+            range.count = i + 1 - range.first;
+            range.bounds = { glm::min(range.bounds.min, bounds.min), glm::max(range.bounds.max, bounds.max) };
+        }
+        else visibleTrees.push_back({ i, 1, bounds });
+        cullStats.treesDrawn++;
+    };
+
+    for (const auto& run : treeRuns)
+    {
+        auto bounds = swept(run.bounds);
+        if (!inView(bounds))
+        {
+            cullStats.treesOutside += run.count;
+            continue;
+        }
+
+        for (auto i = run.first; i < run.first + run.count; i++)
+        {
+            bounds = swept(treeBounds[i]);
+            if (!inView(bounds)) cullStats.treesOutside++;
+            else if (occluded && !occlusion.visible(bounds.min, bounds.max)) cullStats.treesOccluded++;
+            else keep(i, bounds);
+        }
+    }
 
-    // Sort them from back to front
-    std::vector<std::pair<float, gl::Mesh*>> meshesToDraw;
-    meshesToDraw.reserve(terrainMeshes.size());
-    for (std::size_t i = 0; i < terrainMeshes.size(); i++)
+    // One instanced draw per range, with the instances uploaded by update, front to back by the nearest corner
+    // of the range like the chunks
+    for (const auto& range : visibleTrees)
     {
-        if (frustum.checkIntersectionAABB(terrainMin[i], terrainMax[i]))
-            meshesToDraw.emplace_back(util::planeDistanceAABB(frustum.near, terrainMin[i], terrainMax[i]), &terrainMeshes[i]);
+        float nearest = -util::planeDistanceAABB(-frustum.near, range.bounds.min, range.bounds.max);
+        queue.submit(OpaqueLayer, *treesProgram, nearest, [this, first = range.first, count = range.count]
+            { trunkMesh.draw(trunkInstances, first, count); });
+        queue.submit(OpaqueLayer, *treesProgram, nearest, [this, first = range.first, count = range.count]
+            { coneMesh.draw(coneInstances, first, count); });
     }
+}
+
+// Occluders are built from squares of 16 cells, or of 4x4 cells of the level of detail when these are bigger
+constexpr std::size_t OccluderPyramidLevel = 3;
+
+void Terrain::enableOcclusion(const glm::vec3& eye, const glm::mat4& viewProjection, util::thread_pool& pool)
+{
+    // From under the surface (or outside of the resident chunks) the terrain hides nothing for sure
+    occlusionEnabled = false;
+    auto ground = (*this)(eye.x, eye.z);
+    if (!std::isfinite(ground) || eye.y <= ground) return;
+
+    occlusion.begin(viewProjection);
+    for (const auto& [distance, chunk, level] : selectChunks(viewProjection)) addOccluders(*chunk, level);
+    occlusion.rasterize(pool);
+
+    occlusionViewProjection = viewProjection;
+    occlusionEnabled = true;
+}
+
+void Terrain::disableOcclusion()
+{
+    occlusionEnabled = false;
+}
+
+void Terrain::addOccluders(const Chunk& chunk, std::size_t level)
+{
+    // A node is drawn flat at the lowest height of its samples. The surface drawn is above that everywhere in it:
+    // the nodes cover whole cells of the level of detail, and the simplified meshes are within their error of the
+    // samples (their triangles only cross the cells along their diagonals, so they are never lower than the
+    // corners of the cells minus the error)
+    auto pyramidLevel = std::min(std::max(OccluderPyramidLevel, level + 1), chunk.heightPyramid.size() - 1);
+    const auto& nodes = chunk.heightPyramid[pyramidLevel];
+    ssize count = nodes.width();
+    float nodeSize = chunkCells / count * resolution;
+    float error = chunk.lods.empty() ? 0 : simplificationError * float(1 << level);
+
+    auto height = [&](ssize i, ssize j) { return nodes(i, j).x - error; };
+    auto corner = [&](ssize i, ssize j, float h) { return glm::vec3(chunk.min.x + i * nodeSize, h, chunk.max.z - j * nodeSize); };
+    auto wall = [&](ssize i0, ssize j0, ssize i1, ssize j1, float low, float high)
+    {
+        if (low < high) occlusion.add_quad(corner(i0, j0, low), corner(i1, j1, low), corner(i1, j1, high), corner(i0, j0, high));
+    };
+
+    // Everything under the surface is hidden too, so the steps between the nodes get walls, and so do the borders
+    // with the resident neighbours, down to the bottom of the terrain
+    bool neighbours[4] = {
+        chunks.count(chunkKey(chunk.ci - 1, chunk.cj)) > 0, chunks.count(chunkKey(chunk.ci + 1, chunk.cj)) > 0,
+        chunks.count(chunkKey(chunk.ci, chunk.cj - 1)) > 0, chunks.count(chunkKey(chunk.ci, chunk.cj + 1)) > 0 };
+
+    for (ssize j = 0; j < count; j++)
+        for (ssize i = 0; i < count; i++)
+        {
+            auto h = height(i, j);
+            occlusion.add_quad(corner(i, j, h), corner(i + 1, j, h), corner(i + 1, j + 1, h), corner(i, j + 1, h));
+
+            if (i + 1 < count)
+            {
+                auto next = height(i + 1, j);
+                wall(i + 1, j, i + 1, j + 1, std::min(h, next), std::max(h, next));
+            }
+            if (j + 1 < count)
+            {
+                auto next = height(i, j + 1);
+                wall(i, j + 1, i + 1, j + 1, std::min(h, next), std::max(h, next));
+            }
 
-    std::sort(meshesToDraw.begin(), meshesToDraw.end());
-    for (auto& mesh : meshesToDraw) mesh.second->draw(glm::mat4(1.0));
+            if (i == 0 && neighbours[0]) wall(0, j, 0, j + 1, globalMinHeight, h);
+            if (i == count - 1 && neighbours[1]) wall(count, j, count, j + 1, globalMinHeight, h);
+            if (j == 0 && neighbours[2]) wall(i, 0, i + 1, 0, globalMinHeight, h);
+            if (j == count - 1 && neighbours[3]) wall(i, count, i + 1, count, globalMinHeight, h);
+        }
+}
+
+std::vector<std::tuple<float, const Terrain::Chunk*, std::size_t>> Terrain::selectChunks(const glm::mat4& viewProjection) const
+{
+    auto frustum = util::frustumPlanes(viewProjection);
+
+    // Sort them by distance, and pick the level of detail from the distance to the viewer
+    std::vector<std::tuple<float, const Chunk*, std::size_t>> selected;
+    selected.reserve(chunks.size());
+    for (const auto& [key, chunk] : chunks)
+    {
+        // The skirts can reach under the lowest sample
+        auto min = glm::vec3(chunk.min.x, std::min(chunk.min.y, chunk.heightRange.x), chunk.min.z);
+        if (frustum.checkIntersectionAABB(chunk.min, chunk.max) && util::planeDistanceAABB(clipPlane, min, chunk.max) > 0)
+        {
+            auto distance = glm::distance(lodCenter, glm::clamp(lodCenter, chunk.min, chunk.max));
+            auto level = std::upper_bound(lodDistances.begin(), lodDistances.end(), distance) - lodDistances.begin();
+            level = std::min<std::ptrdiff_t>(level, lods.size() - 1);
+            selected.emplace_back(util::planeDistanceAABB(frustum.near, chunk.min, chunk.max), &chunk, level);
+        }
+    }
 
-    treesProgram->use();
-    trunkMesh.draw(trunkInstances);
-    coneMesh.draw(coneInstances);
+    std::sort(selected.begin(), selected.end());
+    return selected;
+}
+
+TerrainViewStats Terrain::getViewStats(const glm::mat4& viewProjection) const
+{
+    auto frustum = util::frustumPlanes(viewProjection);
+    float nodeSize = 2 * resolution;
+
+    TerrainViewStats stats = {};
+    for (const auto& [distance, chunk, level] : selectChunks(viewProjection))
+    {
+        const auto& range = chunk->lods.empty() ? lods[level] : chunk->lods[level];
+        stats.drawCalls++;
+        stats.triangles += range.count / 3;
+
+        // The share of the chunk in the frustum, in squares of 2x2 cells (the first level of the height pyramid),
+        // stands for the share of its triangles
+        const auto& nodes = chunk->heightPyramid.front();
+        std::size_t inView = 0;
+        for (ssize j = 0; j < ssize(nodes.height()); j++)
+            for (ssize i = 0; i < ssize(nodes.width()); i++)
+            {
+                auto heights = nodes(i, j);
+                auto min = glm::vec3(chunk->min.x + i * nodeSize, heights.x, chunk->max.z - (j + 1) * nodeSize);
+                auto max = glm::vec3(chunk->min.x + (i + 1) * nodeSize, heights.y, chunk->max.z - j * nodeSize);
+                inView += frustum.checkIntersectionAABB(min, max);
+            }
+
+        stats.trianglesInView += range.count / 3 * inView / (nodes.width() * nodes.height());
+    }
+
+    return stats;
 }
 
 float Terrain::operator()(float x, float z) const
 {
-    float i = x / resolution, j = -z / resolution;
+    return sample(x, z, nullptr);
+}
 
-    if (i < -xofs || j < -yofs || i > -xofs + heights.width() - 1 || j > -yofs + heights.height() - 1)
-        return -std::numeric_limits<float>::infinity();
+float Terrain::sample(float x, float z, glm::vec3* normal) const
+{
+    float i = x / resolution, j = -z / resolution;
 
-    // Get the integer (offsetted) and fractional parts
+    // Get the integer and fractional parts
     ssize ti = std::floor(i), tj = std::floor(j);
     auto fi = i - ti, fj = j - tj;
-    ti += xofs; tj += yofs;
+
+    // The normal of flat ground, for the points that are not on the terrain
+    if (normal) *normal = glm::vec3(0, 1, 0);
+
+    // And find the chunk and the position inside it
+    ssize li, lj;
+    auto chunk = findChunk(ti, tj, li, lj);
+    if (!chunk) return -std::numeric_limits<float>::infinity();
+
+    const auto& heights = chunk->heights;
+    auto Last = chunkCells;
+
+    // The last sample of a chunk is only found when the next chunk is not resident, so it must be exactly on it
+    if ((li == Last && fi > 0) || (lj == Last && fj > 0))
+        return -std::numeric_limits<float>::infinity();
+
+    // Slopes of the triangle the point is in, along i and j
+    float di = 0, dj = 0;
+    float height;
 
     // Special cases for the end edges
-    if (ti == heights.width() - 1 && tj == heights.height() - 1)
-        return heights(ti, tj);
-    else if (ti == heights.width() - 1)
-        return (1 - fj) * heights(ti, tj) + fj * heights(ti, tj + 1);
-    else if (tj == heights.height() - 1)
-        return (1 - fi) * heights(ti, tj) + fi * heights(ti + 1, tj);
+    if (li == Last && lj == Last)
+        height = heights(li, lj);
+    else if (li == Last)
+    {
+        height = (1 - fj) * heights(li, lj) + fj * heights(li, lj + 1);
+        dj = heights(li, lj + 1) - heights(li, lj);
+    }
+    else if (lj == Last)
+    {
+        height = (1 - fi) * heights(li, lj) + fi * heights(li + 1, lj);
+        di = heights(li + 1, lj) - heights(li, lj);
+    }
     else
     {
         // Follow the mesh topology, so not really a bilinear interpolation
-        if (fi + fj <= 1.0f)
-            return (1 - fi) * heights(ti, tj) + (fi - fj) * heights(ti + 1, tj) + fj * heights(ti + 1, tj + 1);
-        else return (1 - fj) * heights(ti, tj) + (fj - fi) * heights(ti, tj + 1) + fi * heights(ti + 1, tj + 1);
+        if (fj <= fi)
+        {
+            height = (1 - fi) * heights(li, lj) + (fi - fj) * heights(li + 1, lj) + fj * heights(li + 1, lj + 1);
+            di = heights(li + 1, lj) - heights(li, lj);
+            dj = heights(li + 1, lj + 1) - heights(li + 1, lj);
+        }
+        else
+        {
+            height = (1 - fj) * heights(li, lj) + (fj - fi) * heights(li, lj + 1) + fi * heights(li + 1, lj + 1);
+            di = heights(li + 1, lj + 1) - heights(li, lj + 1);
+            dj = heights(li, lj + 1) - heights(li, lj);
+        }
     }
+
+    // The j axis points to -z
+    if (normal) *normal = glm::normalize(glm::vec3(-di / resolution, 1, dj / resolution));
+    return height;
+}
+
+void Terrain::sampleHeights(const glm::vec2* points, std::size_t count, float* heights, glm::vec3* normals) const
+{
+    using namespace util::simd;
+    ssize size = chunkCells + 1;
+    float cells = chunkCells;
+
+    // Consecutive points are usually in the same chunk, so remember the last one
+    const Chunk* chunk = nullptr;
+    float lastCi = 0, lastCj = 0;
+
+    for (std::size_t first = 0; first < count; first += Width)
+    {
+        auto n = std::min(Width, count - first);
+
+        // The last batch is padded with copies of the last point, so the transposition below always has
+        // a full batch (a clamped index there is enough to stop the compiler from turning it into shuffles)
+        glm::vec2 padded[Width];
+        auto batch = points + first;
+        if (n < Width)
+        {
+            for (std::size_t k = 0; k < Width; k++) padded[k] = batch[std::min(k, n - 1)];
+            batch = padded;
+        }
+
+        float xs[Width], zs[Width];
+        for (std::size_t k = 0; k < Width; k++)
+            xs[k] = batch[k].x, zs[k] = batch[k].y;
+
+        // Same steps as sample(), on Width points at a time
+        auto i = load(xs) / floatv(resolution), j = -load(zs) / floatv(resolution);
+        auto ti = floor(i), tj = floor(j);
+        auto fi = i - ti, fj = j - tj;
+        auto ci = floor(ti * (1.0f / cells)), cj = floor(tj * (1.0f / cells));
+
+        // The gathers only work within one chunk, so batches that straddle chunks (or fall outside of the
+        // resident ones) go through the scalar path, which also deals with the borders of the world
+        float c[Width];
+        store(c, ci);
+        auto ci0 = c[0];
+        store(c, cj);
+        auto cj0 = c[0];
+
+        auto sameChunk = (ci >= floatv(ci0)) & (ci <= floatv(ci0)) & (cj >= floatv(cj0)) & (cj <= floatv(cj0));
+        if (all(sameChunk) && (!chunk || ci0 != lastCi || cj0 != lastCj))
+        {
+            auto it = chunks.find(chunkKey(ssize(ci0), ssize(cj0)));
+            chunk = it == chunks.end() ? nullptr : &it->second;
+            lastCi = ci0, lastCj = cj0;
+        }
+
+        if (!all(sameChunk) || !chunk)
+        {
+            for (std::size_t k = 0; k < n; k++)
+                heights[first + k] = sample(points[first + k].x, points[first + k].y, normals ? &normals[first + k] : nullptr);
+            continue;
+        }
+
+        // Inside a chunk, the cell and the one after it are always there
+        auto li = ti - ci * cells, lj = tj - cj * cells;
+        auto base = truncate(lj * float(size) + li);
+        auto data = chunk->heights.data();
+        auto h00 = gather(data, base), h10 = gather(data, base + 1);
+        auto h01 = gather(data, base + std::int32_t(size)), h11 = gather(data, base + std::int32_t(size + 1));
+
+        auto lower = fj <= fi;
+        auto one = floatv(1.0f);
+        auto height = select(lower, (one - fi) * h00 + (fi - fj) * h10 + fj * h11,
+            (one - fj) * h00 + (fj - fi) * h01 + fi * h11);
+        storePartial(heights + first, height, n);
+
+        if (normals)
+        {
+            auto di = select(lower, h10 - h00, h11 - h01) / floatv(resolution);
+            auto dj = select(lower, h11 - h10, h01 - h00) / floatv(resolution);
+            auto invLength = one / sqrt(di * di + dj * dj + one);
+
+            float nx[Width], ny[Width], nz[Width];
+            store(nx, -di * invLength);
+            store(ny, invLength);
+            store(nz, dj * invLength);
+            for (std::size_t k = 0; k < n; k++)
+                normals[first + k] = glm::vec3(nx[k], ny[k], nz[k]);
+        }
+    }
+}
+
+void Terrain::sampleHeights(util::thread_pool& pool, const glm::vec2* points, std::size_t count, float* heights,
+    glm::vec3* normals) const
+{
+    // Large pieces, so the chunk lookups stay cached within each one
+    constexpr std::size_t PointsPerTask = 4096;
+    pool.parallel_for(std::size_t(0), count, PointsPerTask, [&](std::size_t begin, std::size_t end)
+    {
+        sampleHeights(points + begin, end - begin, heights + begin, normals ? normals + begin : nullptr);
+    });
+}
+
+// Parametric interval of the ray (o + t d, in grid coordinates) over the rectangle [min, max], or an empty one
+static glm::vec2 clipRay(const glm::vec2& o, const glm::vec2& invD, const glm::vec2& min, const glm::vec2& max)
+{
+    auto t0 = (min - o) * invD, t1 = (max - o) * invD;
+
+    // A zero component gives infinities (fine), or NaN when the origin is on the border, which fmin/fmax skip
+    auto near = glm::vec2(std::fmin(t0.x, t1.x), std::fmin(t0.y, t1.y));
+    auto far = glm::vec2(std::fmax(t0.x, t1.x), std::fmax(t0.y, t1.y));
+    return glm::vec2(std::fmax(near.x, near.y), std::fmin(far.x, far.y));
+}
+
+float Terrain::raycastChunk(const Chunk& chunk, const glm::vec3& o, const glm::vec3& d, float tmin, float tmax)
+{
+    // Everything here is in the grid coordinates of the chunk: (i, j, height)
+    ssize cells = chunk.heights.width() - 1;
+    auto origin = glm::vec3(o.x - chunk.ci * cells, o.y - chunk.cj * cells, o.z);
+    auto invD = 1.0f / glm::vec2(d.x, d.y);
+    auto rayHeight = [&](float t) { return origin.z + t * d.z; };
+    const auto& heights = chunk.heights;
+
+    struct Node { int level; ssize i, j; float t0, t1; };
+    Node stack[4 * 8];
+    int top = 0;
+
+    stack[top++] = { int(chunk.heightPyramid.size()), 0, 0, tmin, tmax };
+    while (top > 0)
+    {
+        auto node = stack[--top];
+
+        // The ray is monotonous in height, so over an interval it is lowest at one of the ends
+        if (std::min(rayHeight(node.t0), rayHeight(node.t1)) > (node.level == 0
+            ? std::max({ heights(node.i, node.j), heights(node.i + 1, node.j), heights(node.i, node.j + 1), heights(node.i + 1, node.j + 1) })
+            : chunk.heightPyramid[node.level - 1](node.i, node.j).y))
+            continue;
+
+        if (node.level == 0)
+        {
+            // The two triangles of the cell, split by the diagonal (the ray crosses it at most once)
+            auto h00 = heights(node.i, node.j), h10 = heights(node.i + 1, node.j);
+            auto h01 = heights(node.i, node.j + 1), h11 = heights(node.i + 1, node.j + 1);
+            auto fi = [&](float t) { return origin.x + t * d.x - node.i; };
+            auto fj = [&](float t) { return origin.y + t * d.y - node.j; };
+
+            // Height of the ray above the surface, at the parameter t, with the plane of one of the triangles
+            auto above = [&](float t, bool lower)
+            {
+                float a = fi(t), b = fj(t);
+                float h = lower ? (1 - a) * h00 + (a - b) * h10 + b * h11 : (1 - b) * h00 + (b - a) * h01 + a * h11;
+                return rayHeight(t) - h;
+            };
+
+            float pieces[3] = { node.t0, node.t1, node.t1 };
+            float dg = d.x - d.y;
+            if (dg != 0)
+            {
+                float tc = (node.i - node.j + origin.y - origin.x) / dg;
+                if (tc > node.t0 && tc < node.t1) pieces[1] = tc;
+            }
+
+            for (int k = 0; k < 2; k++)
+            {
+                float ta = pieces[k], tb = pieces[k + 1];
+                if (k == 1 && ta >= tb) break;
+
+                // Which triangle, from the middle of the piece
+                float tm = 0.5f * (ta + tb);
+                bool lower = fj(tm) <= fi(tm);
+                float fa = above(ta, lower), fb = above(tb, lower);
+                if (fa <= 0) return ta;
+                if (fb <= 0) return ta + (tb - ta) * fa / (fa - fb);
+            }
+
+            continue;
+        }
+
+        // Push the children that the ray goes through, the farthest first so the nearest is popped first
+        ssize childSize = ssize(1) << (node.level - 1);
+        Node children[4];
+        int numChildren = 0;
+        for (ssize cj = 0; cj < 2; cj++)
+            for (ssize ci = 0; ci < 2; ci++)
+            {
+                ssize i = 2 * node.i + ci, j = 2 * node.j + cj;
+                auto span = clipRay(glm::vec2(origin), invD, glm::vec2(i, j) * float(childSize), glm::vec2(i + 1, j + 1) * float(childSize));
+                span = glm::vec2(std::max(span.x, node.t0), std::min(span.y, node.t1));
+                if (span.x <= span.y) children[numChildren++] = { node.level - 1, i, j, span.x, span.y };
+            }
+
+        std::sort(children, children + numChildren, [](const Node& a, const Node& b) { return a.t0 > b.t0; });
+        for (int k = 0; k < numChildren; k++) stack[top++] = children[k];
+    }
+
+    return std::numeric_limits<float>::infinity();
+}
+
+float Terrain::raycast(const TerrainRay& ray) const
+{
+    // Grid coordinates: the j axis points to -z, and the heights stay as they are
+    auto o = glm::vec3(ray.origin.x / resolution, -ray.origin.z / resolution, ray.origin.y);
+    auto d = glm::vec3(ray.direction.x / resolution, -ray.direction.z / resolution, ray.direction.y);
+
+    // Walk through the chunks in the order the ray crosses them (Amanatides & Woo, with chunks as voxels)
+    float cells = chunkCells;
+    ssize ci = std::floor(o.x / cells), cj = std::floor(o.y / cells);
+    ssize stepI = d.x >= 0 ? 1 : -1, stepJ = d.y >= 0 ? 1 : -1;
+    constexpr float Infinity = std::numeric_limits<float>::infinity();
+    float nextI = d.x != 0 ? ((ci + (d.x > 0)) * cells - o.x) / d.x : Infinity;
+    float nextJ = d.y != 0 ? ((cj + (d.y > 0)) * cells - o.y) / d.y : Infinity;
+    float deltaI = d.x != 0 ? cells / std::abs(d.x) : Infinity;
+    float deltaJ = d.y != 0 ? cells / std::abs(d.y) : Infinity;
+
+    // Nothing to hit once the ray is above everything and going up, or under everything and going down (so the
+    // rays that pass under the terrain where a chunk is missing don't hit the sides of the resident ones)
+    float tmax = ray.maxDistance;
+    if (d.z > 0) tmax = std::min(tmax, (globalMaxHeight - o.z) / d.z);
+    if (d.z < 0) tmax = std::min(tmax, std::max(0.0f, (globalMinHeight - o.z) / d.z));
+
+    float t = 0;
+    while (t <= tmax)
+    {
+        // Nor once the ray is past the resident chunks and going away from them, or level and above everything
+        if ((ci < residentMinI && stepI < 0) || (ci > residentMaxI && stepI > 0) || ((ci < residentMinI || ci > residentMaxI) && d.x == 0) ||
+            (cj < residentMinJ && stepJ < 0) || (cj > residentMaxJ && stepJ > 0) || ((cj < residentMinJ || cj > residentMaxJ) && d.y == 0) ||
+            (d.z == 0 && o.z > globalMaxHeight))
+            break;
+
+        float exit = std::min({ nextI, nextJ, tmax });
+        auto it = chunks.find(chunkKey(ci, cj));
+        if (it != chunks.end())
+        {
+            auto hit = raycastChunk(it->second, o, d, t, exit);
+            if (hit < Infinity) return hit;
+        }
+
+        if (exit >= tmax) break;
+        if (nextI < nextJ) ci += stepI, t = nextI, nextI += deltaI;
+        else cj += stepJ, t = nextJ, nextJ += deltaJ;
+    }
+
+    return Infinity;
+}
+
+void Terrain::raycast(const TerrainRay* rays, std::size_t count, float* distances) const
+{
+    for (std::size_t k = 0; k < count; k++)
+        distances[k] = raycast(rays[k]);
+}
+
+void Terrain::raycast(util::thread_pool& pool, const TerrainRay* rays, std::size_t count, float* distances) const
+{
+    constexpr std::size_t RaysPerTask = 64;
+    pool.parallel_for(std::size_t(0), count, RaysPerTask, [&](std::size_t begin, std::size_t end)
+    {
+        raycast(rays + begin, end - begin, distances + begin);
+    });
+}
+
+float Terrain::sampleAt(ssize i, ssize j) const
+{
+    ssize li, lj;
+    if (auto chunk = findChunk(i, j, li, lj)) return chunk->heights(li, lj);
+
+    // Past the resident chunks, the terrain is what the generator says
+    float h;
+    terrainFunction->sampleRow(i, j, resolution, &h, 1);
+    return h;
+}
+
+void Terrain::deform(TerrainBrush brush, float x, float z, float radius, float strength)
+{
+    if (radius <= 0 || strength <= 0) return;
+
+    // The brush in grid units (j goes towards -Z), and the samples under it
+    float bi = x / resolution, bj = -z / resolution, r = radius / resolution;
+    ssize imin = std::ceil(bi - r), imax = std::floor(bi + r);
+    ssize jmin = std::ceil(bj - r), jmax = std::floor(bj + r);
+    if (imin > imax || jmin > jmax) return;
+
+    float target = 0;
+    if (brush == TerrainBrush::Flatten && std::isinf(target = (*this)(x, z))) return;
+
+    auto deformed = [&](ssize i, ssize j, float h)
+    {
+        float d2 = ((i - bi) * (i - bi) + (j - bj) * (j - bj)) / (r * r);
+        if (d2 >= 1) return h;
+
+        float step = strength * (1 - d2) * (1 - d2);
+        switch (brush)
+        {
+        case TerrainBrush::Raise: return h + step;
+        case TerrainBrush::Lower: return h - step;
+        default: return h + glm::clamp(target - h, -step, step);
+        }
+    };
+
+    // The chunks with a copy of the samples, or with normals next to them
+    std::vector<Chunk*> touched;
+    for (auto cj = floorDiv(jmin - 2, chunkCells); cj <= floorDiv(jmax + 1, chunkCells); cj++)
+        for (auto ci = floorDiv(imin - 2, chunkCells); ci <= floorDiv(imax + 1, chunkCells); ci++)
+        {
+            auto it = chunks.find(chunkKey(ci, cj));
+            if (it != chunks.end()) touched.push_back(&it->second);
+        }
+
+    // All the heights first, so the normals see the neighbouring chunks already edited; the samples shared
+    // by two chunks get the same update in both
+    for (auto chunk : touched)
+    {
+        auto oi = chunk->ci * chunkCells, oj = chunk->cj * chunkCells;
+        for (auto j = std::max(jmin, oj); j <= std::min(jmax, oj + chunkCells); j++)
+            for (auto i = std::max(imin, oi); i <= std::min(imax, oi + chunkCells); i++)
+                chunk->heights(i - oi, j - oj) = deformed(i, j, chunk->heights(i - oi, j - oj));
+    }
+
+    for (auto chunk : touched)
+    {
+        if (updateEditedChunk(*chunk, imin, jmin, imax, jmax) && !chunk->lods.empty())
+        {
+            memoryUsage -= chunk->memoryUsage;
+            simplifyChunk(*chunk, simplificationError);
+            uploadElements(*chunk);
+            memoryUsage += chunk->memoryUsage;
+        }
+
+        globalMinHeight = std::min(globalMinHeight, chunk->min.y);
+        globalMaxHeight = std::max(globalMaxHeight, chunk->max.y);
+    }
+}
+
+// Everything that depends on the heights of the samples [imin, imax] x [jmin, jmax] (global coordinates);
+// returns whether the chunk has any of these samples
+bool Terrain::updateEditedChunk(Chunk& chunk, ssize imin, ssize jmin, ssize imax, ssize jmax)
+{
+    ssize size = chunkCells + 1, Last = chunkCells;
+    auto oi = chunk.ci * chunkCells, oj = chunk.cj * chunkCells;
+    auto& heights = chunk.heights;
+
+    // The edited samples in this chunk, and the normals that depend on them (one more sample around)
+    ssize hi0 = std::max(imin - oi, ssize(0)), hi1 = std::min(imax - oi, Last);
+    ssize hj0 = std::max(jmin - oj, ssize(0)), hj1 = std::min(jmax - oj, Last);
+    ssize ni0 = std::max(imin - 1 - oi, ssize(0)), ni1 = std::min(imax + 1 - oi, Last);
+    ssize nj0 = std::max(jmin - 1 - oj, ssize(0)), nj1 = std::min(jmax + 1 - oj, Last);
+    if (ni0 > ni1 || nj0 > nj1) return false;
+
+    // The edited surface has no analytic slopes, so these are central differences, the samples past the
+    // border coming from the neighbours
+    auto height = [&](ssize i, ssize j)
+    {
+        return i >= 0 && i <= Last && j >= 0 && j <= Last ? heights(i, j) : sampleAt(oi + i, oj + j);
+    };
+
+    ssize width = ni1 - ni0 + 1;
+    std::vector<glm::i16vec2> normals(width * (nj1 - nj0 + 1));
+    for (auto j = nj0; j <= nj1; j++)
+        for (auto i = ni0; i <= ni1; i++)
+        {
+            float dx = height(i + 1, j) - height(i - 1, j);
+            float dy = height(i, j + 1) - height(i, j - 1);
+            auto normal = glm::normalize(glm::vec3(-dx, 2 * resolution, dy));
+            normals[(j - nj0) * width + i - ni0] = encodeNormal(normal);
+            chunk.nys(i, j) = normal.y;
+        }
+
+    auto skirtBase = size * size;
+    gl::MeshBuilder update;
+    bool heightsChanged = hi0 <= hi1 && hj0 <= hj1;
+    if (heightsChanged)
+    {
+        // The pyramid nodes over the cells around the edited samples, then the bounds from its top
+        updateHeightPyramid(chunk, std::max(hi0 - 1, ssize(0)), std::max(hj0 - 1, ssize(0)),
+            std::min(hi1, Last - 1), std::min(hj1, Last - 1));
+        auto range = chunk.heightPyramid.back()(0, 0);
+
+        // The mesh keeps its quantization as long as the heights and the skirts fit in it (deeper skirts than
+        // needed are fine), otherwise the whole chunk is quantized again
+        auto skirtDepth = computeSkirtDepth(heights);
+        if (skirtDepth > chunk.skirtDepth || range.x - chunk.skirtDepth - SkirtMargin < chunk.heightRange.x
+            || range.y > chunk.heightRange.x + chunk.heightRange.y)
+        {
+            chunk.skirtDepth = std::max(skirtDepth, chunk.skirtDepth);
+            float base = range.x - chunk.skirtDepth - SkirtMargin;
+            chunk.heightRange = glm::vec2(base, std::max(range.y - base, std::numeric_limits<float>::min()));
+
+            update.packedPositions.resize(skirtBase + 4 * size);
+            for (ssize j = 0; j < size; j++)
+                for (ssize i = 0; i < size; i++)
+                    update.packedPositions[j * size + i] = quantizeHeight(chunk.heightRange, heights(i, j));
+            for (ssize k = 0; k < size; k++)
+                for (auto [edge, i, j] : { std::tuple(0, k, ssize(0)), std::tuple(1, k, Last),
+                    std::tuple(2, ssize(0), k), std::tuple(3, Last, k) })
+                    update.packedPositions[skirtBase + edge * size + k] =
+                        quantizeHeight(chunk.heightRange, heights(i, j) - chunk.skirtDepth - SkirtMargin);
+            chunk.mesh.updateVertices(0, update);
+        }
+
+        chunk.min.y = range.x;
+        chunk.max.y = range.y;
+
+        // The trees stand on the lowest of the five samples around them (they are never on the border)
+        std::size_t firstMoved = chunk.treePositions.size(), lastMoved = 0;
+        for (std::size_t t = 0; t < chunk.treePositions.size(); t++)
+        {
+            auto& position = chunk.treePositions[t];
+            auto i = ssize(std::lround(position.x / resolution)) - oi, j = ssize(std::lround(-position.z / resolution)) - oj;
+            auto base = std::min({ heights(i, j), heights(i + 1, j), heights(i - 1, j), heights(i, j - 1), heights(i, j + 1) });
+            if (base != position.y) position.y = base, firstMoved = std::min(firstMoved, t), lastMoved = t;
+
+            chunk.min.y = std::min(chunk.min.y, position.y);
+            chunk.max.y = std::max(chunk.max.y, position.y + chunk.coneTransforms[t][3][1] + ConeHeight);
+        }
+
+        // Only the trees that moved are written again and uploaded, unless all of them will be anyway
+        if (firstMoved <= lastMoved && !treesChanged)
+        {
+            auto& run = treeRuns[chunk.treeRun];
+            for (auto t = firstMoved; t <= lastMoved; t++) setTreeInstance(chunk, t, run.first + t);
+            updateTreeRunBounds(run);
+
+            auto count = lastMoved - firstMoved + 1;
+            trunkInstances.updateInstances(run.first + firstMoved, &trunkFinalTransforms[run.first + firstMoved], count);
+            coneInstances.updateInstances(run.first + firstMoved, &coneFinalTransforms[run.first + firstMoved], count);
+        }
+    }
+
+    // Only the rows of the normals rectangle go to the GPU, plus the skirt vertices below them
+    auto uploadRun = [&](std::size_t first, ssize count, auto&& coordinates, float offset)
+    {
+        update.packedPositions.resize(count);
+        update.packedNormals.resize(count);
+        for (ssize k = 0; k < count; k++)
+        {
+            auto [i, j] = coordinates(k);
+            update.packedPositions[k] = quantizeHeight(chunk.heightRange, heights(i, j) - offset);
+            update.packedNormals[k] = normals[(j - nj0) * width + i - ni0];
+        }
+        chunk.mesh.updateVertices(first, update);
+    };
+
+    for (auto j = nj0; j <= nj1; j++)
+        uploadRun(j * size + ni0, width, [&](ssize k) { return std::pair(ni0 + k, j); }, 0);
+
+    float skirtOffset = chunk.skirtDepth + SkirtMargin;
+    if (nj0 == 0)
+        uploadRun(skirtBase + ni0, width, [&](ssize k) { return std::pair(ni0 + k, ssize(0)); }, skirtOffset);
+    if (nj1 == Last)
+        uploadRun(skirtBase + size + ni0, width, [&](ssize k) { return std::pair(ni0 + k, Last); }, skirtOffset);
+    if (ni0 == 0)
+        uploadRun(skirtBase + 2 * size + nj0, nj1 - nj0 + 1, [&](ssize k) { return std::pair(ssize(0), nj0 + k); }, skirtOffset);
+    if (ni1 == Last)
+        uploadRun(skirtBase + 3 * size + nj0, nj1 - nj0 + 1, [&](ssize k) { return std::pair(Last, nj0 + k); }, skirtOffset);
+
+    return heightsChanged;
 }
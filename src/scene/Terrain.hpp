@@ -2,74 +2,353 @@
 
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include "resources/Mesh.hpp"
 #include "resources/Program.hpp"
+#include "resources/RenderQueue.hpp"
 #include "util/grid.hpp"
+#include "util/thread_pool.hpp"
+#include "util/occlusion_buffer.hpp"
 #include <glm/vec3.hpp>
 #include <mutex>
 #include <atomic>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+#include <tuple>
 #include "TerrainFunction.hpp"
 #include "Lighting.hpp"
 
 namespace scene
 {
+    // Parameters of the chunk pager, for terrains that are generated around the camera
+    struct TerrainStreaming final
+    {
+        // Chunks closer than this to the camera (in the XZ plane) are kept resident
+        float viewDistance = 512;
+
+        // Past this, the chunks that are out of the view distance are evicted, least recently used first
+        std::size_t memoryBudget = std::size_t(384) << 20;
+
+        // Limits for the asynchronous generation (0 in flight means the concurrency of the pool)
+        std::size_t maxChunksInFlight = 0;
+        std::size_t maxUploadsPerFrame = 4;
+    };
+
+    // What a brush does to the heights under it
+    enum class TerrainBrush
+    {
+        Raise, Lower,
+
+        // Towards the height at the center of the brush
+        Flatten
+    };
+
+    // Triangles of a chunk at full detail (without the skirts), with and without the simplification
+    struct TerrainChunkStats final
+    {
+        std::ptrdiff_t ci, cj;
+        std::size_t triangles, fullTriangles;
+    };
+
+    // What a view of the terrain costs: the chunks drawn (a draw call each), their triangles, and about how many
+    // of these are on the parts of the chunks that are in the frustum
+    struct TerrainViewStats final
+    {
+        std::size_t drawCalls, triangles, trianglesInView;
+    };
+
+    // What the culling of the last draw did with the chunks and the trees: drawn, out of the frustum (or on the
+    // side of the clip plane that is cut away), or hidden behind the terrain (only in the draws with the view
+    // given to enableOcclusion)
+    struct TerrainCullStats final
+    {
+        std::size_t chunksDrawn, chunksOutside, chunksOccluded;
+        std::size_t treesDrawn, treesOutside, treesOccluded;
+    };
+
+    // The segment from origin to origin + maxDistance * direction; maxDistance can be infinity, the cast stops
+    // anyway once the ray is past the resident chunks, or above or under all of them, for good
+    struct TerrainRay final
+    {
+        glm::vec3 origin, direction;
+        float maxDistance = std::numeric_limits<float>::infinity();
+    };
+
     class Terrain final
     {
+        using ssize = std::make_signed_t<std::size_t>;
+
+        // The elements of the mesh used for one level of detail
+        struct LodRange
+        {
+            std::size_t first, count;
+        };
+
+        // A square of cells of the terrain, with its own copy of the samples (the last row and
+        // column are the same as the first of the next chunks)
+        struct Chunk
+        {
+            ssize ci, cj;
+            util::grid<float> heights, nys;
+            glm::vec3 min, max;
+
+            // Min and max heights over squares of 2, 4... cells, up to the whole chunk, for the ray casts
+            std::vector<util::grid<glm::vec2>> heightPyramid;
+
+            // The mesh stores the heights as 16-bit fractions of this range (base, extent), skirts included
+            glm::vec2 heightRange;
+            float skirtDepth;
+
+            // The trees standing on this chunk, and the index of their run in the instances (set by update)
+            std::vector<glm::vec3> treePositions;
+            std::vector<glm::mat4> trunkTransforms;
+            std::vector<glm::mat4> coneTransforms;
+            std::size_t treeRun;
+
+            // The chunk's own triangulation when the terrain is simplified (otherwise it uses the shared
+            // one); the indices are only kept until they are uploaded, like the builder
+            std::vector<std::uint16_t> simplifiedIndices;
+            std::vector<LodRange> lods;
+            gl::ElementBuffer elements;
+
+            // The builder is only kept until the mesh is uploaded (in the thread with the context); the mesh
+            // has a skirt around it to hide the cracks between chunks of different levels of detail
+            gl::MeshBuilder builder;
+            gl::Mesh mesh;
+
+            std::size_t memoryUsage;
+            std::uint64_t lastUsed;
+        };
+
+        // The heights of a rectangle of the grid starting at (imin, jmin), with their slopes in x and y
+        struct SampledRegion
+        {
+            ssize imin, jmin;
+            util::grid<float> heights, dxs, dys;
+        };
+
+        // What the pager shares with the generation tasks, so it must not move with the terrain
+        struct StreamingState
+        {
+            TerrainStreaming settings;
+            util::thread_pool& pool;
+            util::task_group tasks;
+
+            std::mutex readyMutex;
+            std::vector<Chunk> ready;
+            std::unordered_set<std::uint64_t> inFlight;
+
+            StreamingState(const TerrainStreaming& settings, util::thread_pool& pool) : settings(settings), pool(pool) {}
+            ~StreamingState() { pool.wait(tasks); }
+        };
+
         std::shared_ptr<gl::Program> terrainProgram;
         std::shared_ptr<gl::Program> treesProgram;
 
-        using ssize = std::make_signed_t<std::size_t>;
-        TerrainFunction terrainFunction;
+        // Set once per chunk drawn
+        gl::Uniform<glm::vec2> chunkOriginUniform, heightRangeUniform;
+
+        std::shared_ptr<const TerrainFunction> terrainFunction;
 
-        // Drawable meshes for generation
-        std::vector<gl::MeshBuilder> temporaryBuilders;
-        std::vector<gl::Mesh> terrainMeshes;
+        // Resident chunks, indexed by chunkKey
+        std::unordered_map<std::uint64_t, Chunk> chunks;
+        std::unique_ptr<StreamingState> streaming;
+        std::uint64_t frame;
+        std::size_t memoryUsage;
+
+        // The topology shared by all the chunk meshes, with the range of each level of detail in it
+        gl::ElementBuffer chunkElements;
+        std::vector<LodRange> lods;
+
+        // Geometric error allowed to the simplification of the chunks (0 for the full grid)
+        float simplificationError = 0;
+
+        // Levels of detail: level k is used past lodDistances[k - 1] from lodCenter
+        std::vector<float> lodDistances = { 96, 192, 384, 768, 1536 };
+        glm::vec3 lodCenter = glm::vec3(0);
+        std::size_t trianglesDrawn = 0, fullTriangles = 0;
 
         // Dirt texture
         gl::Texture3D dirtTexture;
 
-        // Drawing of trees
+        // Drawing of trees: the instances of all of them, uploaded when the resident chunks change
         gl::Mesh trunkMesh, coneMesh;
         gl::InstanceSet trunkInstances, coneInstances;
+        bool treesChanged = false;
+
+        // The instances of every tree and their bounds without the sway, in runs of the trees of each chunk
+        struct TreeBounds
+        {
+            glm::vec3 min, max;
+        };
 
-        // Used for collisions
-        ssize xofs, yofs;
-        util::grid<float> heights, nys;
-        util::grid<float> treeHeights;
+        struct TreeRun
+        {
+            std::size_t first, count;
+            TreeBounds bounds;
+        };
+
+        std::vector<glm::mat4> trunkFinalTransforms, coneFinalTransforms;
+        std::vector<TreeBounds> treeBounds;
+        std::vector<TreeRun> treeRuns;
+
+        // The ranges of instances left by the culling, drawn straight from the instances of all the trees, with the
+        // bounds of their visible trees (kept between the passes so they don't allocate)
+        std::vector<TreeRun> visibleTrees;
+
+        // The terrain seen from the main view, as occluders for the culling
+        util::occlusion_buffer occlusion;
+        glm::mat4 occlusionViewProjection;
+        bool occlusionEnabled = false;
+        TerrainCullStats cullStats = {};
+
+        // Where gl_ClipDistance cuts the terrain and the trees (the default keeps everything)
+        glm::vec4 clipPlane = glm::vec4(0, 0, 0, 1);
+
+        // Used for collisions: the range of the heights, and the chunks (inclusive) around the resident ones
         float globalMinHeight, globalMaxHeight;
+        ssize residentMinI = 0, residentMinJ = 0, residentMaxI = -1, residentMaxJ = -1;
         float resolution;
+        ssize chunkCells;
+        std::uint64_t seed;
+        double generationTime;
 
-        // Used for grid generation (and optimizations later)
-        util::grid<float> maxHeight;
-        util::grid<float> minHeight;
-        std::vector<glm::vec3> terrainMin;
-        std::vector<glm::vec3> terrainMax;
+        // Tiles on disk, in a directory named after cacheKey (empty if there's no cache)
+        std::filesystem::path cacheDirectory;
+        std::uint64_t cacheKey;
 
         // For tree animation
-        std::vector<glm::vec3> treePositions;
-        std::vector<glm::mat4> trunkTransforms;
-        std::vector<glm::mat4> coneTransforms;
-        glm::vec2 shearingEllipse;
+        glm::vec2 shearingEllipse, sway = glm::vec2(0);
         float shearingRotation, time;
 
-        void buildTerrain(ssize xmin, ssize ymin, ssize xmax, ssize ymax, int seed, bool wi = false, bool wj = false);
-        void buildTrees(int seed);
+        static std::uint64_t chunkKey(ssize ci, ssize cj);
+        const Chunk* findChunk(ssize i, ssize j, ssize& li, ssize& lj) const;
+
+        static SampledRegion sampleRegion(util::thread_pool& pool, const TerrainFunction& function, float resolution,
+            ssize imin, ssize jmin, ssize width, ssize height);
+        static Chunk buildChunk(util::thread_pool& pool, const SampledRegion& samples, float resolution,
+            std::uint64_t seed, ssize cells, ssize ci, ssize cj);
+        static void buildTrees(Chunk& chunk, float resolution, std::uint64_t seed);
+        static void finishChunk(Chunk& chunk);
+        static void updateHeightPyramid(Chunk& chunk, ssize imin, ssize jmin, ssize imax, ssize jmax);
+        static std::vector<LodRange> buildTopology(ssize size, std::vector<std::uint16_t>& indices);
+        static void appendSkirts(ssize size, ssize step, std::vector<std::uint16_t>& indices);
+        static void simplifyChunk(Chunk& chunk, float maxError);
+        static float raycastChunk(const Chunk& chunk, const glm::vec3& origin, const glm::vec3& direction,
+            float tmin, float tmax);
+
+        static std::filesystem::path tilePath(const std::filesystem::path& directory, ssize ci, ssize cj);
+        static bool loadChunk(const std::filesystem::path& directory, std::uint64_t key, ssize cells, ssize ci, ssize cj,
+            Chunk& chunk);
+        static void saveChunk(const std::filesystem::path& directory, std::uint64_t key, const Chunk& chunk);
+
+        void createResources(int seed);
+        void openCache(const std::filesystem::path& root, int seed, float width, float height);
+        void scheduleChunk(ssize ci, ssize cj);
+        void insertChunk(Chunk&& chunk);
+        void uploadElements(Chunk& chunk);
+        void updateResidentBounds();
+        void setTreeInstance(const Chunk& chunk, std::size_t i, std::size_t index);
+        void updateTreeRunBounds(TreeRun& run);
+        void evictChunks(std::size_t reserve);
         void generateDirtTexture(int seed);
 
+        // The chunks in the frustum, sorted by distance, with the level of detail to draw them at
+        std::vector<std::tuple<float, const Chunk*, std::size_t>> selectChunks(const glm::mat4& viewProjection) const;
+        void addOccluders(const Chunk& chunk, std::size_t level);
+        void drawTrees(gl::RenderQueue& queue, const glm::mat4& viewProjection, bool occluded);
+
+        float sample(float x, float z, glm::vec3* normal) const;
+        float sampleAt(ssize i, ssize j) const;
+        bool updateEditedChunk(Chunk& chunk, ssize imin, ssize jmin, ssize imax, ssize jmax);
+
     public:
+        // Cells along the side of a chunk, a power of two: bigger chunks mean fewer draw calls and generation
+        // tasks, smaller ones mean finer culling and streaming (see --tune-terrain to pick one for a machine)
+        static constexpr std::size_t MinChunkCells = 32, MaxChunkCells = 128, DefaultChunkCells = 128;
+
         Terrain() = default;
-        Terrain(float width, float height, float resolution, int seed);
+
+        // A bounded world of width x height units centered on the origin, generated up front; if a cache
+        // directory is given, the chunks are loaded from there when possible and saved there otherwise
+        Terrain(float width, float height, float resolution, int seed, util::thread_pool& pool = util::thread_pool::global(),
+            const std::filesystem::path& cacheDirectory = {}, std::size_t chunkCells = DefaultChunkCells);
+
+        // An unbounded world, paged in around the camera (the chunks around center are generated up front)
+        Terrain(float resolution, int seed, const TerrainStreaming& settings, const glm::vec3& center,
+            util::thread_pool& pool = util::thread_pool::global(), const std::filesystem::path& cacheDirectory = {},
+            std::size_t chunkCells = DefaultChunkCells);
 
         void update(double delta);
 
+        // Request the chunks around the camera and upload the finished ones; no-op for bounded terrains
+        void stream(const glm::vec3& position, const glm::mat4& viewProjection);
+
+        // The levels of detail are picked from the distance to this point, normally the camera (so the
+        // passes rendered from another point of view, like the shadows, use the same levels)
+        void setLodCenter(const glm::vec3& position);
+        void setLodDistances(std::vector<float> distances);
+
+        // Triangulate each chunk on its own, without the vertices that are within about maxError (in height units)
+        // of the surface left by dropping them; level k of detail gets 2^k maxError, and 0 goes back to the full grid.
+        // Applies to the resident chunks too; while it's on, an edit redoes the whole triangulation of the chunks
+        void setSimplification(float maxError, util::thread_pool& pool = util::thread_pool::global());
+        std::vector<TerrainChunkStats> getChunkStats() const;
+
         void setColors(const glm::u8vec4& grassColor, const glm::u8vec4& sandColor, const glm::u8vec4& mountainColor);
+        // The chunks and trees entirely on the negative side of the plane are culled, so it must be reset to
+        // (0, 0, 0, 1) once the passes that clip are done
         void setClipPlane(const glm::vec4& plane);
-        void draw(const glm::mat4& projection, const glm::mat4& view, const Lighting& lighting);
+        // Submits a draw per chunk in view, and the trees, for the pass set on the lighting; the queue must be executed before the next draw or update
+        void draw(gl::RenderQueue& queue, const glm::mat4& projection, const glm::mat4& view);
+
+        // Rasterize the terrain seen from eye on the CPU, so the next draws with this same view skip the chunks and
+        // the trees hidden behind it, until disableOcclusion. The occluders stay under the surface drawn, so this
+        // only holds with the eye above the terrain (otherwise it's a no-op), and without a clip plane
+        void enableOcclusion(const glm::vec3& eye, const glm::mat4& viewProjection,
+            util::thread_pool& pool = util::thread_pool::global());
+        void disableOcclusion();
+        auto getCullStats() const { return cullStats; }
 
         auto getGlobalMinHeight() const { return globalMinHeight; }
         auto getGlobalMaxHeight() const { return globalMaxHeight; }
 
+        // Time spent building the chunks, in seconds
+        auto getGenerationTime() const { return generationTime; }
+
+        // Stats of the resident chunks, the memory being an estimate of the CPU and GPU data
+        auto getResidentChunks() const { return chunks.size(); }
+        auto getMemoryUsage() const { return memoryUsage; }
+
+        // Triangles of the last draw call, and how many it would have been at full resolution
+        auto getTrianglesDrawn() const { return trianglesDrawn; }
+        auto getFullResolutionTriangles() const { return fullTriangles; }
+
+        // What draw would do from this point of view (with the current center of the levels of detail)
+        TerrainViewStats getViewStats(const glm::mat4& viewProjection) const;
+
+        // Height of the terrain, or -infinity if the position isn't on a resident chunk
         float operator()(float x, float z) const;
+
+        // The same for a batch of (x, z) points, optionally with the normals of the surface there (straight up
+        // outside of the terrain); the second one splits the batch between the threads of the pool
+        void sampleHeights(const glm::vec2* points, std::size_t count, float* heights, glm::vec3* normals = nullptr) const;
+        void sampleHeights(util::thread_pool& pool, const glm::vec2* points, std::size_t count, float* heights,
+            glm::vec3* normals = nullptr) const;
+
+        // Parameter (in units of the direction) of the first point of the ray on or under the terrain, or infinity;
+        // the chunks that aren't resident are empty space (line of sight between a and b: no hit for (a, b - a, 1))
+        float raycast(const TerrainRay& ray) const;
+        void raycast(const TerrainRay* rays, std::size_t count, float* distances) const;
+        void raycast(util::thread_pool& pool, const TerrainRay* rays, std::size_t count, float* distances) const;
+
+        // Edit the resident chunks with a round brush of the given radius centered on (x, z); strength is the
+        // most the heights move, at the center (the brush has a smooth falloff). Only the samples under the
+        // brush and the normals around them are updated, and only the touched rows go to the GPU. The edits
+        // aren't saved to the tile cache, and the chunks that aren't resident (or are being generated) miss them
+        void deform(TerrainBrush brush, float x, float z, float radius, float strength);
     };
 }
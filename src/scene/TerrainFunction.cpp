@@ -1,47 +1,28 @@
 #include "TerrainFunction.hpp"
+#include "NoiseGraph.hpp"
 
 using namespace scene;
 
-#include <random>
-#include <cmath>
-
-constexpr float Pi = 3.14159265359f;
-constexpr float KernelSize = 0.25f;
-constexpr float BorderSize = 8;
-
-static float flattenFunction(float x)
+// The terrain: terraced hills from a fractal noise, with a finer simplex noise on top to perturb them
+static const auto TerrainGraph = []
 {
-    if (x < 1 - KernelSize) return 0;
-    return 0.5f + 0.5f * std::sin(Pi * (x - (1 - KernelSize / 2)) / KernelSize);
-}
+    using namespace noise;
+    auto baseHeight = max(160.0f * scale(perlinFractal(0), 0.7f) + 20.0f, -20.0f);
+    return terrace(baseHeight, 20.0f, 140.0f) + scale(simplex(2.5f), 8.0f) + 4.0f;
+}();
 
-static float flattener(float x, float levelHeights, float maxHeight = std::numeric_limits<float>::infinity())
+float TerrainFunction::operator()(float x, float y)
 {
-    if (x > maxHeight) return x;
-
-    float v = x / levelHeights;
-    float nv = std::floor(v) + flattenFunction(v - std::floor(v));
-    return nv * levelHeights;
+    return TerrainGraph({ noise, batchNoise }, x, y);
 }
 
-float lerp(float a, float b, float m)
+void TerrainFunction::sampleRow(std::ptrdiff_t i, std::ptrdiff_t j, float resolution, float* out, std::size_t count) const
 {
-    return a + m * (b - a);
+    noise::sampleRow(TerrainGraph, { noise, batchNoise }, i, j, resolution, out, nullptr, nullptr, count);
 }
 
-float TerrainFunction::operator()(float x, float y)
+void TerrainFunction::sampleRow(std::ptrdiff_t i, std::ptrdiff_t j, float resolution, float* out, float* dx, float* dy,
+    std::size_t count) const
 {
-    // Create the base heights
-    float baseHeight = 160 * noise.GetPerlinFractal(x * 0.7f, y * 0.7f, 0) + 20;
-    baseHeight = std::max(baseHeight, -20.0f);
-
-    // Calculate the flattened height
-    baseHeight = flattener(baseHeight, 20.0f, 140.0f);
-
-    // Now, perturb the heights with a simplex noise
-    float perturbation = 1 * noise.GetSimplex(x * 8, y * 8, 2.5f);
-
-    // This should be the final height, but
-    float th = baseHeight + perturbation + 4;
-    return th;
+    noise::sampleRow(TerrainGraph, { noise, batchNoise }, i, j, resolution, out, dx, dy, count);
 }
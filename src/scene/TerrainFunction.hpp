@@ -2,18 +2,34 @@
 
 #include <FastNoise/FastNoise.h>
 #include <cstddef>
+#include <cstdint>
+#include "BatchNoise.hpp"
 
 namespace scene
 {
+    // The heights are a noise graph (see NoiseGraph.hpp), defined in the source file
     class TerrainFunction final
     {
         float width, height;
         FastNoise noise;
+        BatchNoise batchNoise;
 
     public:
+        // Bump this whenever the graph changes, it invalidates the tiles cached on disk
+        static constexpr std::uint32_t Version = 1;
+
         TerrainFunction() = default;
         explicit TerrainFunction(float width, float height, int seed = 0) 
-            : width(width), height(height), noise(seed) {}
+            : width(width), height(height), noise(seed), batchNoise(noise) {}
         float operator()(float x, float y);
+
+        // Vectorized evaluation of count samples of the grid row j, starting at column i,
+        // where the sample (i, j) is at (i * resolution, j * resolution)
+        void sampleRow(std::ptrdiff_t i, std::ptrdiff_t j, float resolution, float* out, std::size_t count) const;
+
+        // The same, with the analytic derivatives of the heights along x and y (so the normal is (-dx, 1, dy) in the
+        // world, where the grid rows go towards -Z)
+        void sampleRow(std::ptrdiff_t i, std::ptrdiff_t j, float resolution, float* out, float* dx, float* dy,
+            std::size_t count) const;
     };
 }
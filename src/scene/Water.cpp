@@ -4,8 +4,10 @@
 #include "mesh_utils.hpp"
 #include "colors.hpp"
 #include "resources/Cache.hpp"
+#include "Lighting.hpp"
 
 #include "util/grid.hpp"
+#include "util/texture_baker.hpp"
 #include <FastNoise/FastNoise.h>
 #include <random>
 
@@ -63,6 +65,7 @@ Water::Water(float y, float xmin, float zmin, float xmax, float zmax, glfw::Size
         "resources/shaders/water.vert",
         "resources/shaders/water.frag" });
     waterProgram->setName("Water Program");
+    Lighting::setupProgram(*waterProgram);
 
     queryProgram = cache::loadProgram({
         "resources/shaders/position.vert",
@@ -74,19 +77,19 @@ Water::Water(float y, float xmin, float zmin, float xmax, float zmax, glfw::Size
 
 void Water::generateRipple(int seed)
 {
+    auto& pool = util::thread_pool::global();
     for (std::size_t k = 0; k < 2; k++)
     {
         // Generate the ripple texture
         util::grid<float> heightmaps(256, 256);
         FastNoise noise(seed);
-        for (std::size_t j = 0; j < 256; j++)
-            for (std::size_t i = 0; i < 256; i++)
-                heightmaps(i, j) = 0.8f * noise.GetPerlin(8 * i, 8 * j, 14 * k)
-                    + 0.4f * noise.GetPerlin(16 * i, 16 * j, 28 * k);
+        util::bake_texels(pool, heightmaps, [&](std::size_t i, std::size_t j)
+            {
+                return 0.8f * noise.GetPerlin(8 * i, 8 * j, 14 * k) + 0.4f * noise.GetPerlin(16 * i, 16 * j, 28 * k);
+            });
 
         util::grid<glm::vec2> normals(256, 256);
-        for (std::size_t j = 0; j < 256; j++)
-            for (std::size_t i = 0; i < 256; i++)
+        util::bake_texels(pool, normals, [&](std::size_t i, std::size_t j)
             {
                 glm::vec3 gx, gy;
 
@@ -99,8 +102,8 @@ void Water::generateRipple(int seed)
                 else gy = glm::vec3(0, 1, heightmaps(i, j + 1) - heightmaps(i, j - 1));
 
                 auto normal = glm::normalize(glm::cross(gx, gy));
-                normals(i, j) = glm::vec2(normal.x, normal.y);
-            }
+                return glm::vec2(normal.x, normal.y);
+            });
 
         rippleTextures[k].assign(0, gl::InternalFormat::RG16s, 256, 256, gl::Format::RG, &normals(0, 0).x);
         rippleTextures[k].generateMipmap();
@@ -177,11 +180,9 @@ void Water::endRefraction()
     glDisable(GL_CLIP_DISTANCE0);
 }
 
-void Water::draw(const glm::mat4& projection, const glm::mat4& view)
+void Water::draw(const glm::mat4& view)
 {
     waterProgram->use();
-    waterProgram->setUniform("Projection", projection);
-    waterProgram->setUniform("View", view);
     waterProgram->setUniform("RepeatPeriod", 8.0f);
     waterProgram->setUniform("WaveHeight", 0.1f);
     waterProgram->setUniform("ViewNormal", glm::normalize(glm::vec3(view[1])));
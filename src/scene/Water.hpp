@@ -65,7 +65,8 @@ namespace scene
         void endRefraction();
 
         void update(double delta) { time += delta; }
-        void draw(const glm::mat4& projection, const glm::mat4& view);
+        // With the camera of the pass set on the lighting
+        void draw(const glm::mat4& view);
 
         // Put an occlusion query here to optimize results
         void checkOcclusion(const glm::mat4& projection, const glm::mat4& view);
@@ -0,0 +1,321 @@
+#include <glad/glad.h>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <random>
+#include <limits>
+#include <thread>
+#include <algorithm>
+#include <tuple>
+#include <cmath>
+
+#include "terrainBenchmarks.hpp"
+#include "scene/Terrain.hpp"
+#include "scene/TerrainFunction.hpp"
+#include "scene/Lighting.hpp"
+#include "resources/Query.hpp"
+#include "resources/RenderQueue.hpp"
+#include "util/thread_pool.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+using HighClock = std::chrono::high_resolution_clock;
+
+// The best time of a few runs of the function, divided between its count operations, in nanoseconds
+template <typename F>
+static double nanosecondsPer(std::size_t count, F&& function)
+{
+    double best = std::numeric_limits<double>::infinity();
+    for (int run = 0; run < 5; run++)
+    {
+        auto start = HighClock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double, std::nano>(HighClock::now() - start).count());
+    }
+    return best / count;
+}
+
+// The vectorized rows against the scalar terrain function, over a few seeds, rows and lengths (the odd ones
+// end with a partial vector). The graph sums terms of up to a few hundred units, so the two paths round
+// differently there: the differences are counted in units in the last place of a height of HeightScale units
+// (or of the height itself above it), and can't be more than one
+static bool checkBatchSampling()
+{
+    constexpr float HeightScale = 128.0f, MaxUlps = 1.0f;
+    constexpr float Resolution = 0.5f;
+    constexpr std::ptrdiff_t Rows[] = { -1000, -3, 0, 1, 517 }, Columns = -300;
+    constexpr std::size_t Lengths[] = { 1, 7, 1021 };
+
+    auto ulps = [&](float expected, float value)
+    {
+        auto scale = std::max(std::abs(expected), HeightScale);
+        return std::abs(value - expected) / (std::nextafter(scale, std::numeric_limits<float>::infinity()) - scale);
+    };
+
+    float worst = 0;
+    double scalarTime = 0, batchTime = 0;
+    std::size_t samples = 0;
+    std::vector<float> scalar(Lengths[2]), batch(Lengths[2]), derivedBatch(Lengths[2]), dx(Lengths[2]), dy(Lengths[2]);
+    for (int seed : { 0, 7, 1234 })
+    {
+        scene::TerrainFunction function(0.0f, 0.0f, seed);
+        for (auto j : Rows)
+            for (auto count : Lengths)
+            {
+                auto start = HighClock::now();
+                for (std::size_t k = 0; k < count; k++) scalar[k] = function((Columns + std::ptrdiff_t(k)) * Resolution, j * Resolution);
+                auto middle = HighClock::now();
+                function.sampleRow(Columns, j, Resolution, batch.data(), count);
+                auto end = HighClock::now();
+                function.sampleRow(Columns, j, Resolution, derivedBatch.data(), dx.data(), dy.data(), count);
+
+                scalarTime += std::chrono::duration<double, std::nano>(middle - start).count();
+                batchTime += std::chrono::duration<double, std::nano>(end - middle).count();
+                samples += count;
+
+                for (std::size_t k = 0; k < count; k++)
+                    worst = std::max({ worst, ulps(scalar[k], batch[k]), ulps(scalar[k], derivedBatch[k]) });
+            }
+    }
+
+    bool passed = worst <= MaxUlps;
+    std::cout << "batch sampling: " << (passed ? "ok" : "FAILED") << ", at most " << worst << " ulps from the scalar heights ("
+        << MaxUlps << " allowed), " << std::fixed << std::setprecision(1) << scalarTime / samples << " ns scalar, "
+        << batchTime / samples << " ns batched per sample" << std::endl;
+    return passed;
+}
+
+// Generate the same terrain with an increasing number of threads and report the scaling curve
+static void benchmarkThreads(float size)
+{
+    unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned> threadCounts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    std::cout << "threads    time (ms)    speedup    efficiency" << std::endl;
+
+    double baseline = 0;
+    for (auto threads : threadCounts)
+    {
+        // The thread that waits counts as one
+        util::thread_pool pool(threads - 1);
+        scene::Terrain terrain(size, size, 0.5, 0, pool);
+
+        auto time = terrain.getGenerationTime();
+        if (baseline == 0) baseline = time;
+
+        std::cout << std::setw(7) << threads << std::fixed << std::setprecision(1)
+            << std::setw(13) << 1000 * time << std::setprecision(2)
+            << std::setw(11) << baseline / time << std::setw(14) << baseline / time / threads << std::endl;
+    }
+}
+
+// A cold and a warm start with the tile cache, on a scratch directory
+static void benchmarkTileCache(float size)
+{
+    auto cacheDirectory = std::filesystem::temp_directory_path() / "terrain-benchmark-cache";
+    std::filesystem::remove_all(cacheDirectory);
+
+    {
+        scene::Terrain cold(size, size, 0.5, 0, util::thread_pool::global(), cacheDirectory);
+        scene::Terrain warm(size, size, 0.5, 0, util::thread_pool::global(), cacheDirectory);
+        std::cout << "tile cache: cold " << std::fixed << std::setprecision(1) << 1000 * cold.getGenerationTime()
+            << " ms, warm " << 1000 * warm.getGenerationTime() << " ms" << std::endl;
+    }
+
+    std::filesystem::remove_all(cacheDirectory);
+}
+
+// Simplification of the chunks: the triangles left at full detail, in total and for the best and worst chunks
+static void benchmarkSimplification(scene::Terrain& terrain)
+{
+    std::cout << "max error    triangles left    per chunk (best, worst)    time (ms)" << std::endl;
+    for (float maxError : { 0.01f, 0.05f, 0.2f })
+    {
+        auto start = HighClock::now();
+        terrain.setSimplification(maxError);
+        auto time = std::chrono::duration<double, std::milli>(HighClock::now() - start).count();
+
+        std::size_t triangles = 0, fullTriangles = 0;
+        double best = 1, worst = 0;
+        for (const auto& chunk : terrain.getChunkStats())
+        {
+            triangles += chunk.triangles;
+            fullTriangles += chunk.fullTriangles;
+            best = std::min(best, double(chunk.triangles) / chunk.fullTriangles);
+            worst = std::max(worst, double(chunk.triangles) / chunk.fullTriangles);
+        }
+
+        std::cout << std::fixed << std::setprecision(2) << std::setw(9) << maxError << std::setprecision(1)
+            << std::setw(17) << 100.0 * triangles / fullTriangles << "%" << std::setw(14) << 100 * best << "%"
+            << std::setw(8) << 100 * worst << "%" << std::setw(13) << time << std::endl;
+    }
+    terrain.setSimplification(0);
+}
+
+// Height queries: points scattered over the whole world, and the same number in small clusters
+// (like the objects around the camera, or a flock), one by one and batched
+static void benchmarkHeightQueries(const scene::Terrain& terrain, float size)
+{
+    constexpr std::size_t NumQueries = 1 << 20, ClusterSize = 1024;
+    std::mt19937 random(0);
+    std::uniform_real_distribution coordGen(-size / 2, size / 2), offsetGen(0.0f, 8.0f);
+    std::vector<glm::vec2> scattered(NumQueries), clustered(NumQueries);
+    for (auto& point : scattered) point = glm::vec2(coordGen(random), coordGen(random));
+    for (std::size_t k = 0; k < NumQueries; k += ClusterSize)
+    {
+        auto center = glm::vec2(coordGen(random), coordGen(random));
+        for (std::size_t q = k; q < k + ClusterSize; q++) clustered[q] = center + glm::vec2(offsetGen(random), offsetGen(random));
+    }
+
+    std::vector<float> heights(NumQueries);
+    std::vector<glm::vec3> normals(NumQueries);
+
+    std::cout << "height queries (ns)     scattered    clustered" << std::endl;
+    auto row = [&](const char* name, auto&& query)
+    {
+        std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(13) << nanosecondsPer(NumQueries, [&] { query(scattered); })
+            << std::setw(13) << nanosecondsPer(NumQueries, [&] { query(clustered); }) << std::endl;
+    };
+
+    row("one by one", [&](const auto& points)
+        { for (std::size_t k = 0; k < NumQueries; k++) heights[k] = terrain(points[k].x, points[k].y); });
+    row("batched", [&](const auto& points) { terrain.sampleHeights(points.data(), NumQueries, heights.data()); });
+    row("with normals", [&](const auto& points)
+        { terrain.sampleHeights(points.data(), NumQueries, heights.data(), normals.data()); });
+    row("with threads", [&](const auto& points)
+        { terrain.sampleHeights(util::thread_pool::global(), points.data(), NumQueries, heights.data(), normals.data()); });
+}
+
+// Ray casts like the picking ones: from above the terrain, slightly down, for up to a quarter of the world
+static void benchmarkRaycasts(const scene::Terrain& terrain, float size)
+{
+    constexpr std::size_t NumRays = 4096;
+    std::mt19937 random(0);
+    std::uniform_real_distribution coordGen(-size / 2, size / 2), directionGen(-1.0f, 1.0f);
+    std::vector<scene::TerrainRay> rays(NumRays);
+    for (auto& ray : rays)
+    {
+        auto x = coordGen(random), z = coordGen(random);
+        ray.origin = glm::vec3(x, std::max(terrain(x, z), 0.0f) + 20, z);
+        ray.direction = glm::normalize(glm::vec3(directionGen(random), -0.2f, directionGen(random)));
+        ray.maxDistance = size / 4;
+    }
+
+    std::vector<float> distances(NumRays);
+    auto microsecondsPerRay = [&](auto&& cast) { return nanosecondsPer(NumRays, cast) / 1000; };
+    std::cout << "ray casts (us)" << std::fixed << std::setprecision(1) << std::setw(19)
+        << microsecondsPerRay([&] { terrain.raycast(rays.data(), NumRays, distances.data()); }) << std::setw(13)
+        << microsecondsPerRay([&] { terrain.raycast(util::thread_pool::global(), rays.data(), NumRays, distances.data()); })
+        << " (one thread, all threads)" << std::endl;
+}
+
+bool benchmarkTerrain(float size, const std::string& name)
+{
+    static const char* const Names[] = { "batch", "threads", "cache", "simplification", "queries", "rays" };
+    if (!name.empty() && std::find(std::begin(Names), std::end(Names), name) == std::end(Names))
+    {
+        std::cout << "Unknown terrain benchmark " << name << ", expected one of:";
+        for (auto known : Names) std::cout << " " << known;
+        std::cout << std::endl;
+        return false;
+    }
+
+    auto selected = [&](const char* benchmark) { return name.empty() || name == benchmark; };
+    std::cout << "Terrain benchmarks, " << size << "x" << size << " units" << std::endl;
+
+    bool passed = true;
+    if (selected("batch")) passed = checkBatchSampling();
+    if (selected("threads")) benchmarkThreads(size);
+    if (selected("cache")) benchmarkTileCache(size);
+
+    // The other ones work on the same world
+    if (selected("simplification") || selected("queries") || selected("rays"))
+    {
+        scene::Terrain terrain(size, size, 0.5, 0);
+        if (selected("simplification")) benchmarkSimplification(terrain);
+        if (selected("queries")) benchmarkHeightQueries(terrain, size);
+        if (selected("rays")) benchmarkRaycasts(terrain, size);
+    }
+
+    return passed;
+}
+
+// Bigger chunks are fewer draw calls and tasks, smaller ones waste fewer triangles outside of the frustum
+void tuneTerrain(float size)
+{
+    constexpr float Resolution = 0.5f, SimplificationError = 0.05f;
+    constexpr int NumPositions = 4, NumDirections = 8;
+
+    std::cout << "Terrain chunk sizes, " << size << "x" << size << " units, " << NumPositions * NumDirections << " views" << std::endl;
+    std::cout << "cells    generation (ms)    draw calls    triangles    in view    cpu (ms)    gpu (ms)" << std::endl;
+
+    auto projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.5f, size * 1.5f);
+    scene::Lighting lighting;
+    gl::Query timer(gl::QueryType::TimeElapsed);
+    gl::RenderQueue queue;
+
+    // The frame and generation times of each size
+    std::vector<std::tuple<std::size_t, double, double>> results;
+    for (auto cells = scene::Terrain::MinChunkCells; cells <= scene::Terrain::MaxChunkCells; cells *= 2)
+    {
+        scene::Terrain terrain(size, size, Resolution, 0, util::thread_pool::global(), {}, cells);
+        terrain.setSimplification(SimplificationError);
+
+        double drawCalls = 0, triangles = 0, trianglesInView = 0, cpuTime = 0, gpuTime = 0;
+        for (int p = 0; p < NumPositions; p++)
+            for (int d = 0; d < NumDirections; d++)
+            {
+                float angle = 2 * 3.14159265f * p / NumPositions, heading = 2 * 3.14159265f * d / NumDirections;
+                auto position = glm::vec3(std::cos(angle), 0, std::sin(angle)) * (size / 4);
+                position.y = std::max(terrain(position.x, position.z), 0.0f) + 16;
+                auto view = glm::lookAt(position, position + glm::vec3(std::cos(heading), -0.2f, std::sin(heading)), glm::vec3(0, 1, 0));
+
+                terrain.setLodCenter(position);
+                auto stats = terrain.getViewStats(projection * view);
+                drawCalls += stats.drawCalls;
+                triangles += stats.triangles;
+                trianglesInView += stats.trianglesInView;
+
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                auto start = HighClock::now();
+                timer.begin();
+                lighting.setPass(projection, view);
+                terrain.draw(queue, projection, view);
+                queue.execute();
+                timer.end();
+                cpuTime += std::chrono::duration<double, std::milli>(HighClock::now() - start).count();
+                gpuTime += timer.result() / 1e6;
+            }
+
+        constexpr double NumViews = NumPositions * NumDirections;
+        std::cout << std::setw(5) << cells << std::fixed << std::setprecision(1) << std::setw(19) << 1000 * terrain.getGenerationTime()
+            << std::setw(14) << drawCalls / NumViews << std::setw(13) << std::setprecision(0) << triangles / NumViews
+            << std::setw(10) << std::setprecision(1) << 100 * trianglesInView / std::max(triangles, 1.0) << "%"
+            << std::setprecision(3) << std::setw(12) << cpuTime / NumViews << std::setw(12) << gpuTime / NumViews << std::endl;
+
+        // The CPU and the GPU work in parallel, so a frame costs about the slowest of the two
+        results.emplace_back(cells, std::max(cpuTime, gpuTime) / NumViews, terrain.getGenerationTime());
+    }
+
+    // Every chunk is generated once but drawn every frame, so the frames decide, as long as the startup (or the
+    // streaming of the world) isn't much slower than with the size that generates the fastest
+    constexpr double MaxGenerationRatio = 1.5;
+    auto byFrame = [](const auto& a, const auto& b) { return std::get<1>(a) < std::get<1>(b); };
+    auto byGeneration = [](const auto& a, const auto& b) { return std::get<2>(a) < std::get<2>(b); };
+    auto fastestFrames = *std::min_element(results.begin(), results.end(), byFrame);
+    auto fastestGeneration = *std::min_element(results.begin(), results.end(), byGeneration);
+
+    auto best = fastestGeneration;
+    for (const auto& result : results)
+        if (std::get<2>(result) <= MaxGenerationRatio * std::get<2>(fastestGeneration) && byFrame(result, best)) best = result;
+
+    std::cout << "fastest frames: " << std::get<0>(fastestFrames) << ", fastest generation: " << std::get<0>(fastestGeneration) << std::endl;
+    std::cout << "recommended: --chunk-size " << std::get<0>(best) << " (the fastest frames among the sizes that generate within "
+        << std::setprecision(1) << MaxGenerationRatio << "x of the fastest)" << std::endl;
+}
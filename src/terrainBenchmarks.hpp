@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+// The terrain benchmarks, run by --benchmark-terrain [size] [name]: each one prints its own table, and
+// an empty name runs all of them; false if the name is unknown or the check of the batch sampling failed
+bool benchmarkTerrain(float size, const std::string& name = {});
+
+// Build the same world with each chunk size and draw it from a ring of views, run by --tune-terrain [size]; it
+// recommends the size with the fastest frames among the ones that don't generate much slower than the others
+void tuneTerrain(float size);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+namespace util
+{
+    // A random number generator without state: the number at a counter only depends on the seed and the counter
+    // (Widynski's "Squares" with a key derived from the seed), so any element of a sequence can be computed on its
+    // own, on any thread, in any order
+    class counter_rng final
+    {
+        std::uint64_t key;
+
+    public:
+        explicit counter_rng(std::uint64_t seed)
+        {
+            // The key must be odd and have its bits well spread, hence splitmix64
+            std::uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            key = (z ^ (z >> 31)) | 1;
+        }
+
+        std::uint32_t operator()(std::uint64_t counter) const
+        {
+            std::uint64_t x = counter * key, y = x, z = y + key;
+            x = x * x + y; x = (x >> 32) | (x << 32);
+            x = x * x + z; x = (x >> 32) | (x << 32);
+            x = x * x + y; x = (x >> 32) | (x << 32);
+            return std::uint32_t((x * x + z) >> 32);
+        }
+
+        // Uniform in [a, b), from the top 24 bits so every value is exact
+        float uniform(std::uint64_t counter, float a, float b) const
+        {
+            return a + (b - a) * float((*this)(counter) >> 8) * (1.0f / 16777216.0f);
+        }
+    };
+}
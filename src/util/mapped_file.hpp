@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace util
+{
+    // Read-only memory mapping of a whole file; a file that can't be mapped just gives an empty mapping
+    class mapped_file final
+    {
+        const std::byte* _data;
+        std::size_t _size;
+
+        void unmap() noexcept
+        {
+            if (!_data) return;
+#ifdef _WIN32
+            UnmapViewOfFile(_data);
+#else
+            munmap(const_cast<std::byte*>(_data), _size);
+#endif
+            _data = nullptr;
+            _size = 0;
+        }
+
+    public:
+        mapped_file() noexcept : _data(nullptr), _size(0) {}
+
+        explicit mapped_file(const std::filesystem::path& path) : mapped_file()
+        {
+#ifdef _WIN32
+            HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return;
+
+            LARGE_INTEGER size;
+            if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            {
+                // The view keeps the mapping alive, so both handles can be closed right away
+                HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping)
+                {
+                    auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    if (view) _data = static_cast<const std::byte*>(view), _size = size.QuadPart;
+                    CloseHandle(mapping);
+                }
+            }
+
+            CloseHandle(file);
+#else
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                // Same here, the mapping doesn't need the descriptor
+                auto view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (view != MAP_FAILED) _data = static_cast<const std::byte*>(view), _size = st.st_size;
+            }
+
+            close(fd);
+#endif
+        }
+
+        // Disable copying, enable moving
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        mapped_file(mapped_file&& other) noexcept : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)) {}
+        mapped_file& operator=(mapped_file&& other) noexcept
+        {
+            unmap();
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+            return *this;
+        }
+
+        ~mapped_file() { unmap(); }
+
+        const std::byte* data() const { return _data; }
+        std::size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+    };
+}
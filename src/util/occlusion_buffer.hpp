@@ -0,0 +1,258 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+namespace util
+{
+    // A small depth buffer rasterized on the CPU, to reject the objects hidden behind occluders before drawing
+    // them. The occluders must be inside the opaque geometry they stand for; the buffer holds the depth (z/w,
+    // as in normalized device coordinates) of the nearest occluder at each pixel center, and then the farthest
+    // of each 3x3 neighbourhood, so the objects peeking through a gap smaller than a pixel are still drawn
+    class occlusion_buffer final
+    {
+        struct triangle
+        {
+            // Edge functions (positive inside) and -1 / a to find where they cross a row, depth plane, and the pixel bounds
+            float a[3], b[3], c[3], crossing[3];
+            float dx, dy, d0;
+            int xmin, ymin, xmax, ymax;
+        };
+
+        int width, height;
+        int tilesX, tilesY;
+        glm::mat4 viewProjection = glm::mat4(1);
+
+        std::vector<float> depth, rowMax, filtered;
+        std::vector<triangle> triangles;
+        std::vector<std::vector<std::uint32_t>> bins;
+
+        static constexpr int TileWidth = 64, TileHeight = 32;
+        static constexpr float Empty = std::numeric_limits<float>::infinity();
+
+        void setup(const glm::vec4* v)
+        {
+            // To pixels, with the pixel centers on the half integers
+            glm::vec3 p[3];
+            for (int k = 0; k < 3; k++)
+                p[k] = glm::vec3((v[k].x / v[k].w * 0.5f + 0.5f) * width, (v[k].y / v[k].w * 0.5f + 0.5f) * height, v[k].z / v[k].w);
+
+            float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+            if (!(std::abs(area) > 1e-6f)) return;
+
+            triangle t;
+            t.xmin = std::max(int(std::floor(std::min({ p[0].x, p[1].x, p[2].x }))), 0);
+            t.ymin = std::max(int(std::floor(std::min({ p[0].y, p[1].y, p[2].y }))), 0);
+            t.xmax = std::min(int(std::ceil(std::max({ p[0].x, p[1].x, p[2].x }))), width - 1);
+            t.ymax = std::min(int(std::ceil(std::max({ p[0].y, p[1].y, p[2].y }))), height - 1);
+            if (t.xmin > t.xmax || t.ymin > t.ymax) return;
+
+            // Both windings are occluders, so the edges are oriented by the sign of the area
+            float sign = area > 0 ? 1.0f : -1.0f;
+            for (int k = 0; k < 3; k++)
+            {
+                const auto& s = p[k];
+                const auto& e = p[(k + 1) % 3];
+                t.a[k] = sign * (s.y - e.y);
+                t.b[k] = sign * (e.x - s.x);
+                t.c[k] = sign * (s.x * e.y - s.y * e.x);
+                t.crossing[k] = t.a[k] != 0 ? -1 / t.a[k] : 0;
+            }
+
+            t.dx = ((p[1].z - p[0].z) * (p[2].y - p[0].y) - (p[2].z - p[0].z) * (p[1].y - p[0].y)) / area;
+            t.dy = ((p[2].z - p[0].z) * (p[1].x - p[0].x) - (p[1].z - p[0].z) * (p[2].x - p[0].x)) / area;
+            t.d0 = p[0].z - t.dx * p[0].x - t.dy * p[0].y;
+
+            auto index = std::uint32_t(triangles.size());
+            triangles.push_back(t);
+            for (int ty = t.ymin / TileHeight; ty <= t.ymax / TileHeight; ty++)
+                for (int tx = t.xmin / TileWidth; tx <= t.xmax / TileWidth; tx++)
+                    bins[ty * tilesX + tx].push_back(index);
+        }
+
+        void rasterizeTile(int tx, int ty)
+        {
+            using namespace simd;
+            int x0 = tx * TileWidth, y0 = ty * TileHeight;
+            int x1 = std::min(x0 + TileWidth, width) - 1, y1 = std::min(y0 + TileHeight, height) - 1;
+            auto centers = toFloat(iota()) + 0.5f;
+
+            for (auto index : bins[ty * tilesX + tx])
+            {
+                const auto& t = triangles[index];
+                int ymin = std::max(t.ymin, y0), ymax = std::min(t.ymax, y1);
+
+                for (int y = ymin; y <= ymax; y++)
+                {
+                    // The span of the row inside the three edges, from where each of them crosses the row
+                    float py = y + 0.5f;
+                    float lo = float(x0) + 0.5f, hi = float(x1) + 0.5f;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        float c = t.b[k] * py + t.c[k];
+                        if (t.a[k] > 0) lo = std::max(lo, c * t.crossing[k]);
+                        else if (t.a[k] < 0) hi = std::min(hi, c * t.crossing[k]);
+                        else if (c < 0) hi = -Empty;
+                    }
+
+                    // Both ends are past the first pixel center of the tile here, so the casts round down
+                    if (!(lo <= hi)) continue;
+                    int xmin = int(lo - 0.5f), xmax = std::min(int(hi - 0.5f), x1);
+                    if (float(xmin) < lo - 0.5f) xmin++;
+                    if (xmin > xmax) continue;
+
+                    float* row = depth.data() + std::size_t(y) * width;
+                    float rowD = t.dy * py + t.d0;
+                    for (int x = xmin / int(Width) * int(Width); x <= xmax; x += int(Width))
+                    {
+                        auto px = centers + float(x);
+                        auto inside = (px > float(xmin)) & (px < float(xmax) + 1.0f);
+                        auto old = load(row + x);
+                        store(row + x, select(inside, min(old, t.dx * px + rowD), old));
+                    }
+                }
+            }
+        }
+
+    public:
+        // The width is rounded up to the SIMD width
+        explicit occlusion_buffer(int width = 256, int height = 128)
+            : width((width + int(simd::Width) - 1) / int(simd::Width) * int(simd::Width)), height(height)
+        {
+            tilesX = (this->width + TileWidth - 1) / TileWidth;
+            tilesY = (height + TileHeight - 1) / TileHeight;
+            depth.assign(std::size_t(this->width) * height, Empty);
+            rowMax = filtered = depth;
+            bins.resize(tilesX * tilesY);
+        }
+
+        // Start over, for another point of view
+        void begin(const glm::mat4& viewProjection)
+        {
+            this->viewProjection = viewProjection;
+            triangles.clear();
+            for (auto& bin : bins) bin.clear();
+        }
+
+        // A triangle in world space, clipped against the near plane
+        void add_triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+        {
+            glm::vec4 v[3] = { viewProjection * glm::vec4(a, 1), viewProjection * glm::vec4(b, 1), viewProjection * glm::vec4(c, 1) };
+
+            // Nothing to do if the three vertices are out by the same side of the frustum
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (v[0][axis] > v[0].w && v[1][axis] > v[1].w && v[2][axis] > v[2].w) return;
+                if (v[0][axis] < -v[0].w && v[1][axis] < -v[1].w && v[2][axis] < -v[2].w) return;
+            }
+
+            // Clip against z = -w, which leaves a triangle or a quad
+            glm::vec4 clipped[4];
+            int count = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                const auto& s = v[k];
+                const auto& e = v[(k + 1) % 3];
+                float ds = s.z + s.w, de = e.z + e.w;
+                if (ds >= 0) clipped[count++] = s;
+                if ((ds >= 0) != (de >= 0)) clipped[count++] = s + (e - s) * (ds / (ds - de));
+            }
+
+            if (count < 3) return;
+            setup(clipped);
+            if (count == 4)
+            {
+                glm::vec4 second[3] = { clipped[0], clipped[2], clipped[3] };
+                setup(second);
+            }
+        }
+
+        void add_quad(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d)
+        {
+            add_triangle(a, b, c);
+            add_triangle(a, c, d);
+        }
+
+        std::size_t size() const { return triangles.size(); }
+
+        // Rasterize what was added since begin, one task per tile
+        void rasterize(thread_pool& pool)
+        {
+            std::fill(depth.begin(), depth.end(), Empty);
+            pool.parallel_for(0, tilesX * tilesY, 1, [&](int begin, int end)
+            {
+                for (int tile = begin; tile < end; tile++) rasterizeTile(tile % tilesX, tile / tilesX);
+            });
+
+            // Keep the farthest depth of the neighbourhood of each pixel, along the rows and then along the columns
+            pool.parallel_for(0, height, TileHeight, [&](int begin, int end)
+            {
+                for (int y = begin; y < end; y++)
+                {
+                    const float* row = depth.data() + std::size_t(y) * width;
+                    float* out = rowMax.data() + std::size_t(y) * width;
+                    out[0] = std::max(row[0], row[1]);
+                    for (int x = 1; x < width - 1; x++) out[x] = std::max({ row[x - 1], row[x], row[x + 1] });
+                    out[width - 1] = std::max(row[width - 2], row[width - 1]);
+                }
+            });
+
+            pool.parallel_for(0, height, TileHeight, [&](int begin, int end)
+            {
+                using namespace simd;
+                for (int y = begin; y < end; y++)
+                {
+                    const float* above = rowMax.data() + std::size_t(std::max(y - 1, 0)) * width;
+                    const float* row = rowMax.data() + std::size_t(y) * width;
+                    const float* below = rowMax.data() + std::size_t(std::min(y + 1, height - 1)) * width;
+                    float* out = filtered.data() + std::size_t(y) * width;
+                    for (int x = 0; x < width; x += int(Width))
+                        store(out + x, max(max(load(above + x), load(row + x)), load(below + x)));
+                }
+            });
+        }
+
+        // Whether any part of the box might be in front of the occluders (always for the boxes crossing the near plane)
+        bool visible(const glm::vec3& min, const glm::vec3& max) const
+        {
+            using namespace simd;
+
+            glm::vec2 lo(Empty), hi(-Empty);
+            float nearest = Empty;
+            for (int k = 0; k < 8; k++)
+            {
+                auto v = viewProjection * glm::vec4(k & 1 ? max.x : min.x, k & 2 ? max.y : min.y, k & 4 ? max.z : min.z, 1);
+                if (v.z < -v.w || v.w <= 0) return true;
+
+                auto p = glm::vec2((v.x / v.w * 0.5f + 0.5f) * width, (v.y / v.w * 0.5f + 0.5f) * height);
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+                nearest = std::min(nearest, v.z / v.w);
+            }
+
+            int xmin = std::max(int(std::floor(lo.x)), 0), xmax = std::min(int(std::floor(hi.x)), width - 1);
+            int ymin = std::max(int(std::floor(lo.y)), 0), ymax = std::min(int(std::floor(hi.y)), height - 1);
+            if (xmin > xmax || ymin > ymax) return true;
+
+            auto lanes = toFloat(iota());
+            int xstart = xmin / int(Width) * int(Width);
+            for (int y = ymin; y <= ymax; y++)
+            {
+                const float* row = filtered.data() + std::size_t(y) * width;
+                for (int x = xstart; x <= xmax; x += int(Width))
+                {
+                    auto px = lanes + float(x);
+                    if (any((px >= float(xmin)) & (px <= float(xmax)) & (load(row + x) >= nearest))) return true;
+                }
+            }
+
+            return false;
+        }
+    };
+}
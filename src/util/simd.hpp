@@ -0,0 +1,269 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+// Pick the widest instruction set the compiler was allowed to use
+#if defined(__AVX2__)
+#define UTIL_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UTIL_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+// A thin wrapper over the packed float/int registers, so the kernels can be written
+// only once and compiled to AVX2, SSE2 or plain scalar code depending on the target
+namespace util::simd
+{
+#if defined(UTIL_SIMD_AVX2)
+    constexpr std::size_t Width = 8;
+
+    struct maskv final { __m256 v; };
+    struct intv final
+    {
+        __m256i v;
+        intv() = default;
+        intv(__m256i v) : v(v) {}
+        intv(std::int32_t i) : v(_mm256_set1_epi32(i)) {}
+    };
+    struct floatv final
+    {
+        __m256 v;
+        floatv() = default;
+        floatv(__m256 v) : v(v) {}
+        floatv(float f) : v(_mm256_set1_ps(f)) {}
+    };
+
+    inline floatv load(const float* ptr) { return _mm256_loadu_ps(ptr); }
+    inline intv load(const std::int32_t* ptr) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)); }
+    inline void store(float* ptr, floatv v) { _mm256_storeu_ps(ptr, v.v); }
+    inline void store(std::int32_t* ptr, intv v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), v.v); }
+    inline intv iota() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+
+    inline floatv operator+(floatv a, floatv b) { return _mm256_add_ps(a.v, b.v); }
+    inline floatv operator-(floatv a, floatv b) { return _mm256_sub_ps(a.v, b.v); }
+    inline floatv operator*(floatv a, floatv b) { return _mm256_mul_ps(a.v, b.v); }
+    inline floatv operator/(floatv a, floatv b) { return _mm256_div_ps(a.v, b.v); }
+    inline floatv operator-(floatv a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+    inline floatv min(floatv a, floatv b) { return _mm256_min_ps(a.v, b.v); }
+    inline floatv max(floatv a, floatv b) { return _mm256_max_ps(a.v, b.v); }
+    inline floatv sqrt(floatv a) { return _mm256_sqrt_ps(a.v); }
+
+    inline maskv operator<(floatv a, floatv b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    inline maskv operator<=(floatv a, floatv b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    inline maskv operator>(floatv a, floatv b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline maskv operator>=(floatv a, floatv b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+    inline maskv operator&(maskv a, maskv b) { return { _mm256_and_ps(a.v, b.v) }; }
+    inline maskv operator|(maskv a, maskv b) { return { _mm256_or_ps(a.v, b.v) }; }
+    inline maskv operator~(maskv a) { return { _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+    inline bool any(maskv m) { return _mm256_movemask_ps(m.v) != 0; }
+    inline bool all(maskv m) { return _mm256_movemask_ps(m.v) == 0xFF; }
+
+    inline floatv select(maskv m, floatv a, floatv b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+    inline intv select(maskv m, intv a, intv b)
+    {
+        return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), m.v));
+    }
+
+    inline intv operator+(intv a, intv b) { return _mm256_add_epi32(a.v, b.v); }
+    inline intv operator-(intv a, intv b) { return _mm256_sub_epi32(a.v, b.v); }
+    inline intv operator&(intv a, intv b) { return _mm256_and_si256(a.v, b.v); }
+    inline maskv operator<(intv a, intv b) { return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(b.v, a.v)) }; }
+
+    inline intv truncate(floatv a) { return _mm256_cvttps_epi32(a.v); }
+    inline floatv toFloat(intv a) { return _mm256_cvtepi32_ps(a.v); }
+
+    inline intv gather(const std::int32_t* base, intv idx) { return _mm256_i32gather_epi32(base, idx.v, 4); }
+    inline floatv gather(const float* base, intv idx) { return _mm256_i32gather_ps(base, idx.v, 4); }
+
+#elif defined(UTIL_SIMD_SSE2)
+    constexpr std::size_t Width = 4;
+
+    struct maskv final { __m128 v; };
+    struct intv final
+    {
+        __m128i v;
+        intv() = default;
+        intv(__m128i v) : v(v) {}
+        intv(std::int32_t i) : v(_mm_set1_epi32(i)) {}
+    };
+    struct floatv final
+    {
+        __m128 v;
+        floatv() = default;
+        floatv(__m128 v) : v(v) {}
+        floatv(float f) : v(_mm_set1_ps(f)) {}
+    };
+
+    inline floatv load(const float* ptr) { return _mm_loadu_ps(ptr); }
+    inline intv load(const std::int32_t* ptr) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)); }
+    inline void store(float* ptr, floatv v) { _mm_storeu_ps(ptr, v.v); }
+    inline void store(std::int32_t* ptr, intv v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), v.v); }
+    inline intv iota() { return _mm_setr_epi32(0, 1, 2, 3); }
+
+    inline floatv operator+(floatv a, floatv b) { return _mm_add_ps(a.v, b.v); }
+    inline floatv operator-(floatv a, floatv b) { return _mm_sub_ps(a.v, b.v); }
+    inline floatv operator*(floatv a, floatv b) { return _mm_mul_ps(a.v, b.v); }
+    inline floatv operator/(floatv a, floatv b) { return _mm_div_ps(a.v, b.v); }
+    inline floatv operator-(floatv a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+    inline floatv min(floatv a, floatv b) { return _mm_min_ps(a.v, b.v); }
+    inline floatv max(floatv a, floatv b) { return _mm_max_ps(a.v, b.v); }
+    inline floatv sqrt(floatv a) { return _mm_sqrt_ps(a.v); }
+
+    inline maskv operator<(floatv a, floatv b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    inline maskv operator<=(floatv a, floatv b) { return { _mm_cmple_ps(a.v, b.v) }; }
+    inline maskv operator>(floatv a, floatv b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    inline maskv operator>=(floatv a, floatv b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+    inline maskv operator&(maskv a, maskv b) { return { _mm_and_ps(a.v, b.v) }; }
+    inline maskv operator|(maskv a, maskv b) { return { _mm_or_ps(a.v, b.v) }; }
+    inline maskv operator~(maskv a) { return { _mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+    inline bool any(maskv m) { return _mm_movemask_ps(m.v) != 0; }
+    inline bool all(maskv m) { return _mm_movemask_ps(m.v) == 0xF; }
+
+    // No blend instruction on SSE2, so do it the old way
+    inline floatv select(maskv m, floatv a, floatv b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+    inline intv select(maskv m, intv a, intv b)
+    {
+        auto mi = _mm_castps_si128(m.v);
+        return _mm_or_si128(_mm_and_si128(mi, a.v), _mm_andnot_si128(mi, b.v));
+    }
+
+    inline intv operator+(intv a, intv b) { return _mm_add_epi32(a.v, b.v); }
+    inline intv operator-(intv a, intv b) { return _mm_sub_epi32(a.v, b.v); }
+    inline intv operator&(intv a, intv b) { return _mm_and_si128(a.v, b.v); }
+    inline maskv operator<(intv a, intv b) { return { _mm_castsi128_ps(_mm_cmplt_epi32(a.v, b.v)) }; }
+
+    inline intv truncate(floatv a) { return _mm_cvttps_epi32(a.v); }
+    inline floatv toFloat(intv a) { return _mm_cvtepi32_ps(a.v); }
+
+    // SSE2 has no gathers, so spill the indices and load them one by one
+    inline intv gather(const std::int32_t* base, intv idx)
+    {
+        alignas(16) std::int32_t i[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(i), idx.v);
+        return _mm_setr_epi32(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+    }
+
+    inline floatv gather(const float* base, intv idx)
+    {
+        alignas(16) std::int32_t i[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(i), idx.v);
+        return _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+    }
+
+#else
+    constexpr std::size_t Width = 1;
+
+    struct maskv final { bool v; };
+    struct intv final
+    {
+        std::int32_t v;
+        intv() = default;
+        intv(std::int32_t v) : v(v) {}
+    };
+    struct floatv final
+    {
+        float v;
+        floatv() = default;
+        floatv(float v) : v(v) {}
+    };
+
+    inline floatv load(const float* ptr) { return *ptr; }
+    inline intv load(const std::int32_t* ptr) { return *ptr; }
+    inline void store(float* ptr, floatv v) { *ptr = v.v; }
+    inline void store(std::int32_t* ptr, intv v) { *ptr = v.v; }
+    inline intv iota() { return 0; }
+
+    inline floatv operator+(floatv a, floatv b) { return a.v + b.v; }
+    inline floatv operator-(floatv a, floatv b) { return a.v - b.v; }
+    inline floatv operator*(floatv a, floatv b) { return a.v * b.v; }
+    inline floatv operator/(floatv a, floatv b) { return a.v / b.v; }
+    inline floatv operator-(floatv a) { return -a.v; }
+    inline floatv min(floatv a, floatv b) { return b.v < a.v ? b.v : a.v; }
+    inline floatv max(floatv a, floatv b) { return a.v < b.v ? b.v : a.v; }
+    inline floatv sqrt(floatv a) { return std::sqrt(a.v); }
+
+    inline maskv operator<(floatv a, floatv b) { return { a.v < b.v }; }
+    inline maskv operator<=(floatv a, floatv b) { return { a.v <= b.v }; }
+    inline maskv operator>(floatv a, floatv b) { return { a.v > b.v }; }
+    inline maskv operator>=(floatv a, floatv b) { return { a.v >= b.v }; }
+    inline maskv operator&(maskv a, maskv b) { return { a.v && b.v }; }
+    inline maskv operator|(maskv a, maskv b) { return { a.v || b.v }; }
+    inline maskv operator~(maskv a) { return { !a.v }; }
+    inline bool any(maskv m) { return m.v; }
+    inline bool all(maskv m) { return m.v; }
+
+    inline floatv select(maskv m, floatv a, floatv b) { return m.v ? a : b; }
+    inline intv select(maskv m, intv a, intv b) { return m.v ? a : b; }
+
+    inline intv operator+(intv a, intv b) { return a.v + b.v; }
+    inline intv operator-(intv a, intv b) { return a.v - b.v; }
+    inline intv operator&(intv a, intv b) { return a.v & b.v; }
+    inline maskv operator<(intv a, intv b) { return { a.v < b.v }; }
+
+    inline intv truncate(floatv a) { return std::int32_t(a.v); }
+    inline floatv toFloat(intv a) { return float(a.v); }
+
+    inline intv gather(const std::int32_t* base, intv idx) { return base[idx.v]; }
+    inline floatv gather(const float* base, intv idx) { return base[idx.v]; }
+#endif
+
+    // Compound assignments, common to all the implementations
+    inline floatv& operator+=(floatv& a, floatv b) { return a = a + b; }
+    inline floatv& operator-=(floatv& a, floatv b) { return a = a - b; }
+    inline floatv& operator*=(floatv& a, floatv b) { return a = a * b; }
+    inline intv& operator+=(intv& a, intv b) { return a = a + b; }
+
+    // Real floor, valid as long as the value fits into an int
+    inline floatv floor(floatv a)
+    {
+        auto t = toFloat(truncate(a));
+        return select(a < t, t - 1.0f, t);
+    }
+
+    // Polynomial approximation of sin, good to float precision on [-pi/2, pi/2]
+    inline floatv sinHalfPeriod(floatv x)
+    {
+        auto x2 = x * x;
+        auto p = floatv(-2.5052108e-8f);
+        p = p * x2 + 2.7557319e-6f;
+        p = p * x2 - 1.9841270e-4f;
+        p = p * x2 + 8.3333333e-3f;
+        p = p * x2 - 1.6666667e-1f;
+        return x + x * x2 * p;
+    }
+
+    // Same for cos, on the same interval
+    inline floatv cosHalfPeriod(floatv x)
+    {
+        auto x2 = x * x;
+        auto p = floatv(2.0876757e-9f);
+        p = p * x2 - 2.7557319e-7f;
+        p = p * x2 + 2.4801587e-5f;
+        p = p * x2 - 1.3888889e-3f;
+        p = p * x2 + 4.1666667e-2f;
+        p = p * x2 - 0.5f;
+        return 1.0f + x2 * p;
+    }
+
+    // Load and store with a partial count (for the ends of the rows)
+    inline floatv loadPartial(const float* ptr, std::size_t count)
+    {
+        if (count >= Width) return load(ptr);
+
+        float tmp[Width] = {};
+        for (std::size_t i = 0; i < count; i++) tmp[i] = ptr[i];
+        return load(tmp);
+    }
+
+    inline void storePartial(float* ptr, floatv v, std::size_t count)
+    {
+        if (count >= Width) return store(ptr, v);
+
+        float tmp[Width];
+        store(tmp, v);
+        for (std::size_t i = 0; i < count; i++) ptr[i] = tmp[i];
+    }
+}
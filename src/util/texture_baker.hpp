@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include "grid.hpp"
+#include "thread_pool.hpp"
+
+namespace util
+{
+    // Fill out[k] = texel(k) for k in [0, count), in blocks spread over the pool. The texels are computed on their
+    // own (use a counter_rng for the random ones), so the image is the same for any number of threads
+    template <typename T, typename F>
+    void bake_texels(thread_pool& pool, T* out, std::size_t count, F&& texel)
+    {
+        constexpr std::size_t TexelsPerTask = 4096;
+        pool.parallel_for(std::size_t(0), count, TexelsPerTask, [&](std::size_t begin, std::size_t end)
+        {
+            for (auto k = begin; k < end; k++) out[k] = texel(k);
+        });
+    }
+
+    // The same on an image, with texel(i, j), by rows
+    template <typename T, typename F>
+    void bake_texels(thread_pool& pool, grid<T>& image, F&& texel)
+    {
+        std::size_t width = image.width(), rowsPerTask = std::max<std::size_t>(4096 / std::max<std::size_t>(width, 1), 1);
+        pool.parallel_for(std::size_t(0), image.height(), rowsPerTask, [&](std::size_t begin, std::size_t end)
+        {
+            for (auto j = begin; j < end; j++)
+                for (std::size_t i = 0; i < width; i++) image(i, j) = texel(i, j);
+        });
+    }
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+namespace util
+{
+    // A batch of tasks that can be waited on without caring about the other tasks in the pool
+    class task_group final
+    {
+        std::atomic<std::size_t> pending{ 0 };
+        std::mutex exceptionMutex;
+        std::exception_ptr exception;
+
+        friend class thread_pool;
+
+    public:
+        bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+    };
+
+    // Work-stealing pool: each worker pushes and pops its own tasks from the back of its queue,
+    // and steals from the front of the others' queues when it runs out of work
+    class thread_pool final
+    {
+        struct task
+        {
+            std::function<void()> function;
+            task_group* group;
+        };
+
+        struct worker_queue
+        {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+        std::vector<std::unique_ptr<worker_queue>> queues;
+        std::vector<std::thread> workers;
+
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+        std::atomic<std::size_t> queuedTasks{ 0 };
+        std::atomic<std::size_t> nextQueue{ 0 };
+        bool stopping = false;
+
+        inline static thread_local const thread_pool* currentPool = nullptr;
+        inline static thread_local std::size_t currentIndex = 0;
+
+        // The queue the calling thread owns, or any queue if it is not one of our workers
+        std::size_t homeQueue()
+        {
+            if (currentPool == this) return currentIndex;
+            return nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        }
+
+        void push(task&& t)
+        {
+            auto& queue = *queues[homeQueue()];
+            {
+                std::lock_guard lock(queue.mutex);
+                queue.tasks.push_back(std::move(t));
+            }
+
+            // Increment under the lock, otherwise a worker might go to sleep right after checking the counter
+            {
+                std::lock_guard lock(sleepMutex);
+                queuedTasks.fetch_add(1, std::memory_order_release);
+            }
+            sleepCondition.notify_one();
+        }
+
+        // Take a task out of a queue, the first one from its back or from its front that is of the group
+        // (any task without one)
+        static bool take(worker_queue& queue, const task_group* group, bool back, task& t)
+        {
+            std::lock_guard lock(queue.mutex);
+            auto matches = [group](const task& candidate) { return !group || candidate.group == group; };
+
+            auto it = queue.tasks.end();
+            if (back)
+            {
+                auto rit = std::find_if(queue.tasks.rbegin(), queue.tasks.rend(), matches);
+                if (rit != queue.tasks.rend()) it = std::prev(rit.base());
+            }
+            else it = std::find_if(queue.tasks.begin(), queue.tasks.end(), matches);
+
+            if (it == queue.tasks.end()) return false;
+            t = std::move(*it);
+            queue.tasks.erase(it);
+            return true;
+        }
+
+        bool pop(std::size_t index, const task_group* group, task& t)
+        {
+            // First, try our own queue, newest task first (it is the one with the hottest data),
+            // then steal the oldest task of someone else's
+            for (std::size_t k = 0; k < queues.size(); k++)
+            {
+                if (take(*queues[(index + k) % queues.size()], group, k == 0, t))
+                {
+                    queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool runPendingTask(std::size_t index, const task_group* group = nullptr)
+        {
+            task t;
+            if (!pop(index, group, t)) return false;
+
+            try { t.function(); }
+            catch (...)
+            {
+                if (!t.group) throw;
+                std::lock_guard lock(t.group->exceptionMutex);
+                if (!t.group->exception) t.group->exception = std::current_exception();
+            }
+
+            if (t.group) t.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+            return true;
+        }
+
+        void workerLoop(std::size_t index)
+        {
+            currentPool = this;
+            currentIndex = index;
+
+            while (true)
+            {
+                if (runPendingTask(index)) continue;
+
+                std::unique_lock lock(sleepMutex);
+                sleepCondition.wait(lock, [&] { return stopping || queuedTasks.load(std::memory_order_acquire) > 0; });
+                if (stopping && queuedTasks.load(std::memory_order_acquire) == 0) return;
+            }
+        }
+
+    public:
+        // The thread that waits on a group also runs its tasks, so numWorkers can be one less than the cores
+        explicit thread_pool(std::size_t numWorkers)
+        {
+            queues.resize(std::max<std::size_t>(numWorkers, 1));
+            for (auto& queue : queues) queue = std::make_unique<worker_queue>();
+
+            workers.reserve(numWorkers);
+            for (std::size_t i = 0; i < numWorkers; i++)
+                workers.emplace_back([this, i] { workerLoop(i); });
+        }
+
+        ~thread_pool()
+        {
+            {
+                std::lock_guard lock(sleepMutex);
+                stopping = true;
+            }
+            sleepCondition.notify_all();
+            for (auto& worker : workers) worker.join();
+        }
+
+        // Disallow copying and moving, the workers hold a pointer to us
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        // The shared pool, sized to the hardware concurrency, but with at least one worker so
+        // the tasks nobody waits on still make progress
+        static thread_pool& global()
+        {
+            static thread_pool pool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+            return pool;
+        }
+
+        // Number of threads that run tasks when someone is waiting
+        std::size_t concurrency() const { return workers.size() + 1; }
+
+        // Fire and forget
+        template <typename F>
+        void submit(F&& function)
+        {
+            push({ std::forward<F>(function), nullptr });
+        }
+
+        template <typename F>
+        void submit(task_group& group, F&& function)
+        {
+            group.pending.fetch_add(1, std::memory_order_relaxed);
+            push({ std::forward<F>(function), &group });
+        }
+
+        // Help running the tasks of the group until it is finished; only its own, so waiting on a short batch
+        // never runs some long task of another one inline (like the streaming of the terrain, from the render thread)
+        void wait(task_group& group)
+        {
+            while (!group.done())
+            {
+                auto index = currentPool == this ? currentIndex : 0;
+                if (!runPendingTask(index, &group)) std::this_thread::yield();
+            }
+
+            if (group.exception) std::rethrow_exception(std::exchange(group.exception, nullptr));
+        }
+
+        // Split [begin, end) into pieces of at most grain elements and call function(pieceBegin, pieceEnd) on each
+        template <typename Int, typename F>
+        void parallel_for(Int begin, Int end, Int grain, F&& function)
+        {
+            if (end - begin <= grain)
+            {
+                if (begin < end) function(begin, end);
+                return;
+            }
+
+            task_group group;
+            for (Int b = begin; b < end; b += grain)
+            {
+                Int e = std::min(end, b + grain);
+                submit(group, [&function, b, e] { function(b, e); });
+            }
+
+            wait(group);
+        }
+    };
+}